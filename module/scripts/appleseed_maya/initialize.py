@@ -465,6 +465,10 @@ class AppleseedRenderer(renderer.MayaToRenderer):
                 with pm.frameLayout(label="Translator", collapsable=True, collapse=False):
                     with pm.columnLayout(adjustableColumn=True, width=400):
                         self.addRenderGlobalsUIElement(attName='translatorVerbosity', uiType='enum', displayName='Verbosity:', default='0', uiDict=uiDict)
+                        self.addRenderGlobalsUIElement(attName='displayQueuePolicy', uiType='enum', displayName='Display Queue Full:', default='2', uiDict=uiDict)
+                        self.addRenderGlobalsUIElement(attName='progressiveEdgeInterval', uiType='int', displayName='Border Update Interval:', uiDict=uiDict)
+                        self.addRenderGlobalsUIElement(attName='deduplicateMeshes', uiType='bool', displayName='Deduplicate Meshes:', default=False, anno='Share one mesh between shapes with identical geometry.', uiDict=uiDict)
+                        self.addRenderGlobalsUIElement(attName='velocitySources', uiType='string', displayName='Velocity Sources:', anno='Color sets or per vertex attributes holding mesh velocities, separated by spaces. Meshes with velocities are motion blurred without sampling other times.', uiDict=uiDict)
                 with pm.frameLayout(label="appleseed Output", collapsable=True, collapse=False):
                     with pm.columnLayout(adjustableColumn=True, width=400):
                         self.addRenderGlobalsUIElement(attName='exportMode', uiType='enum', displayName='Output Mode:', default='0', uiDict=uiDict, callback=self.AppleseedTranslatorUpdateTab)
@@ -32,6 +32,7 @@
 // appleseed-maya headers.
 #include "utilities/attrtools.h"
 #include "utilities/logging.h"
+#include "utilities/phasetimer.h"
 #include "utilities/tools.h"
 #include "event.h"
 #include "renderqueue.h"
@@ -39,10 +40,15 @@
 
 // Maya headers.
 #include <maya/MArgDatabase.h>
+#include <maya/MDoubleArray.h>
 #include <maya/MGlobal.h>
 #include <maya/MSelectionList.h>
+#include <maya/MStringArray.h>
 #include <maya/MSyntax.h>
 
+// Standard headers.
+#include <vector>
+
 MSyntax AppleseedMaya::syntaxCreator()
 {
     MSyntax syntax;
@@ -54,6 +60,10 @@ MSyntax AppleseedMaya::syntaxCreator()
     syntax.addFlag("-str", "-stopIpr");
     syntax.addFlag("-par", "-pauseIpr");
     syntax.addFlag("-uir", "-updateIprRegion");
+    syntax.addFlag("-qs", "-queueStats");
+    syntax.addFlag("-pr", "-progress");
+    syntax.addFlag("-pt", "-phaseTimes");
+    syntax.enableQuery(true);
     return syntax;
 }
 
@@ -82,12 +92,25 @@ namespace
 MStatus AppleseedMaya::doIt(const MArgList& args)
 {
     MStatus stat = MStatus::kSuccess;
+    MArgDatabase argData(syntax(), args);
+
+    // Polled by the UI while rendering, so keep it quiet and cheap.
+    if (argData.isQuery() && argData.isFlagSet("-progress", &stat))
+    {
+        // Returned as [progress in 0..1, elapsed seconds, remaining seconds or -1].
+        const RenderProgress progress = getRenderProgress();
+        MDoubleArray result;
+        result.append(progress.progress);
+        result.append(progress.elapsed);
+        result.append(progress.remaining);
+        setResult(result);
+        return MS::kSuccess;
+    }
+
     MGlobal::displayInfo("Executing appleseed-maya...");
 
     setLogLevel();
 
-    MArgDatabase argData(syntax(), args);
-
     if (argData.isFlagSet("-state", &stat))
     {
         if (getWorldPtr()->getRenderState() == World::RSTATETRANSLATING)
@@ -103,6 +126,37 @@ MStatus AppleseedMaya::doIt(const MArgList& args)
         return MS::kSuccess;
     }
 
+    if (argData.isFlagSet("-queueStats", &stat))
+    {
+        // Returned as name/value pairs.
+        const RenderEventQueue::Stats stats = getRenderEventQueue().getStats();
+        MStringArray result;
+        result.append("pushed"); result.append(toMString(static_cast<int>(stats.pushed)));
+        result.append("popped"); result.append(toMString(static_cast<int>(stats.popped)));
+        result.append("dropped"); result.append(toMString(static_cast<int>(stats.dropped)));
+        result.append("coalesced"); result.append(toMString(static_cast<int>(stats.coalesced)));
+        result.append("contended"); result.append(toMString(static_cast<int>(stats.contended)));
+        result.append("blocked"); result.append(toMString(static_cast<int>(stats.blocked)));
+        result.append("highWater"); result.append(toMString(static_cast<int>(stats.highWater)));
+        result.append("capacity"); result.append(toMString(static_cast<int>(stats.capacity)));
+        setResult(result);
+        return MS::kSuccess;
+    }
+
+    if (argData.isFlagSet("-phaseTimes", &stat))
+    {
+        // Returned as name/seconds pairs, in the order the phases were started.
+        const std::vector<PhaseTimings::Phase> phases = PhaseTimings::get();
+        MStringArray result;
+        for (size_t i = 0; i < phases.size(); ++i)
+        {
+            result.append(phases[i].name.c_str());
+            result.append(toMString(phases[i].seconds));
+        }
+        setResult(result);
+        return MS::kSuccess;
+    }
+
     if (argData.isFlagSet("-updateIprRegion", &stat))
     {
         iprUpdateRenderRegion();
@@ -37,6 +37,7 @@
 #include "utilities/logging.h"
 #include "utilities/meshtools.h"
 #include "utilities/oslutils.h"
+#include "utilities/phasetimer.h"
 #include "utilities/pystring.h"
 #include "utilities/tools.h"
 #include "appleseedutils.h"
@@ -59,7 +60,11 @@
 #include "renderer/modeling/environmentedf/sphericalcoordinates.h"
 
 // appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/math/aabb.h"
 #include "foundation/platform/thread.h"
+#include "foundation/platform/types.h"
+#include "foundation/utility/string.h"
 
 // Maya headers.
 #include <maya/MFileIO.h>
@@ -76,6 +81,44 @@
 #include <maya/MNodeMessage.h>
 #include <maya/MPointArray.h>
 #include <maya/MRenderView.h>
+#include <maya/MTime.h>
+
+// Boost headers.
+#include "boost/bind.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Render region in render view coordinates, or an invalid box if the
+    // whole frame is rendered.
+    foundation::AABB2u getDisplayCrop()
+    {
+        foundation::AABB2u crop;
+        crop.invalidate();
+
+        const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+        if (renderGlobals->getUseRenderRegion())
+        {
+            int left, bottom, right, top;
+            renderGlobals->getRenderRegion(left, bottom, right, top);
+            crop = foundation::AABB2u(
+                foundation::AABB2u::VectorType(left, bottom),
+                foundation::AABB2u::VectorType(right, top));
+        }
+
+        return crop;
+    }
+}
 
 AppleseedRenderer::AppleseedRenderer()
   : sceneBuilt(false)
@@ -113,19 +156,39 @@ void AppleseedRenderer::unInitializeRenderer()
     getWorldPtr()->setRenderState(World::RSTATEDONE);
     getWorldPtr()->setRenderType(World::RTYPENONE);
 
+    geometryCache.clear();
+
     // todo: isn't this supposed to be reset()?
     project.release();
 }
 
 void AppleseedRenderer::defineProject()
 {
-    defineCamera();
-    defineOutput(); // output accesses camera so define it after camera
+    ScopedPhaseTimer timer("defineProject");
+
+    {
+        ScopedPhaseTimer stepTimer("defineProject.camera");
+        defineCamera();
+        defineOutput(); // output accesses camera so define it after camera
+    }
+
     defineMasterAssembly(project.get());
     defineDefaultMaterial(project.get());
-    defineEnvironment(); // define environment before lights because sun lights may use physical sky edf
-    defineGeometry();
-    defineLights();
+
+    {
+        ScopedPhaseTimer stepTimer("defineProject.environment");
+        defineEnvironment(); // define environment before lights because sun lights may use physical sky edf
+    }
+
+    {
+        ScopedPhaseTimer stepTimer("defineProject.geometry");
+        defineGeometry();
+    }
+
+    {
+        ScopedPhaseTimer stepTimer("defineProject.lights");
+        defineLights();
+    }
 }
 
 void AppleseedRenderer::preFrame()
@@ -139,7 +202,11 @@ void AppleseedRenderer::postFrame()
     renderGlobals->getImageName();
     MString filename = renderGlobals->imageOutputFile.asChar();
     Logging::debug(MString("Saving image as ") + renderGlobals->imageOutputFile);
-    project->get_frame()->write_main_image(renderGlobals->imageOutputFile.asChar());
+
+    {
+        ScopedPhaseTimer timer("writeImage");
+        project->get_frame()->write_main_image(renderGlobals->imageOutputFile.asChar());
+    }
 
     // If we render the very last frame or if we are in UI where the last frame == first frame, then delete the master renderer before
     // the deletion of the assembly because otherwise it will be deleted automatically if the renderer instance is deleted what results in a crash
@@ -148,6 +215,9 @@ void AppleseedRenderer::postFrame()
     if (renderGlobals->currentFrameNumber == renderGlobals->frameList.back())
         masterRenderer.reset();
 
+    // Keep the meshes of this frame for the next one before the world assembly is deleted.
+    geometryCache.park(*project->get_scene()->assemblies().get_by_name("world"));
+
     foundation::UniqueID aiuid = project->get_scene()->assembly_instances().get_by_name("world_Inst")->get_uid();
     foundation::UniqueID auid = project->get_scene()->assemblies().get_by_name("world")->get_uid();
     project->get_scene()->assembly_instances().remove(aiuid);
@@ -159,7 +229,8 @@ void AppleseedRenderer::render()
 {
     if (!sceneBuilt)
     {
-        tileCallbackFac.reset(new TileCallbackFactory());
+        ScopedPhaseTimer timer("createMasterRenderer");
+        tileCallbackFac.reset(new TileCallbackFactory(getDisplayCrop()));
 
         if (getWorldPtr()->getRenderType() == World::IPRRENDER)
         {
@@ -180,13 +251,12 @@ void AppleseedRenderer::render()
                     tileCallbackFac.get()));
         }
 
-        const MFnDependencyNode renderGlobalsFn(getRenderGlobalsNode());
-        const int exportMode = getEnumInt("exportMode", renderGlobalsFn);
-        if (exportMode > 0)
+        // This runs on the render thread, Maya must not be accessed here.
+        const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+        if (renderGlobals->exportMode > 0)
         {
-            const MString outputFile = getStringAttr("exportSceneFileName", renderGlobalsFn, "");
-            renderer::ProjectFileWriter::write(project.ref(), outputFile.asChar());
-            if (exportMode == 1) // export only, no rendering
+            renderer::ProjectFileWriter::write(project.ref(), renderGlobals->exportSceneFileName.asChar());
+            if (renderGlobals->exportMode == 1) // export only, no rendering
                 return;
         }
 
@@ -195,7 +265,33 @@ void AppleseedRenderer::render()
 
     getWorldPtr()->setRenderState(World::RSTATERENDERING);
     mRendererController.set_status(renderer::IRendererController::ContinueRendering);
+
+    ScopedPhaseTimer timer("render");
     masterRenderer->render();
+
+    // Progressive updates skip tiles far from the focus and can be dropped,
+    // so the last pixels of every tile are sent once more.
+    if (getWorldPtr()->getRenderType() == World::IPRRENDER)
+        tileCallbackFac->pushFrame(project->get_frame());
+}
+
+void AppleseedRenderer::updateRenderRegion()
+{
+    // The frame crop window is in top-down image coordinates.
+    const foundation::AABB2u displayCrop = getDisplayCrop();
+    if (displayCrop.is_valid())
+    {
+        const unsigned int height = static_cast<unsigned int>(getWorldPtr()->mRenderGlobals->getHeight());
+        const foundation::AABB2u crop(
+            foundation::AABB2u::VectorType(displayCrop.min.x, height - 1 - displayCrop.max.y),
+            foundation::AABB2u::VectorType(displayCrop.max.x, height - 1 - displayCrop.min.y));
+        project->get_frame()->set_crop_window(crop);
+    }
+    else
+        project->get_frame()->reset_crop_window();
+
+    if (tileCallbackFac.get() != 0)
+        tileCallbackFac->setCrop(displayCrop);
 }
 
 void AppleseedRenderer::abortRendering()
@@ -211,69 +307,66 @@ void AppleseedRenderer::addRenderParams(renderer::ParamArray& paramArray)
     static const char* dlTypes[] = { "rt", "sppm", "off" };
     static const char* samplingModes[] = { "qmc", "rng" };
 
-    MFnDependencyNode renderGlobalsFn(getRenderGlobalsNode());
-    MString lightingEngine = lightingEngines[getEnumInt("lightingEngine", renderGlobalsFn)];
-    MString bucketOrder = bucketOrders[getEnumInt("tile_ordering", renderGlobalsFn)];
-    MString photonType = photonTypes[getEnumInt("photon_type", renderGlobalsFn)];
-    MString dlType = dlTypes[getEnumInt("dl_mode", renderGlobalsFn)];
     boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+    MString lightingEngine = lightingEngines[renderGlobals->lightingEngine];
+    MString bucketOrder = bucketOrders[renderGlobals->tileOrdering];
+    MString photonType = photonTypes[renderGlobals->photonType];
+    MString dlType = dlTypes[renderGlobals->dlMode];
 
-    paramArray.insert_path("texture_store.max_size", getIntAttr("texCacheSize", renderGlobalsFn, 128) * 1024 * 1024); // at least 128 MB
+    paramArray.insert_path("texture_store.max_size", renderGlobals->texCacheSize * 1024 * 1024); // at least 128 MB
 
-    paramArray.insert("sampling_mode", samplingModes[getEnumInt("sampling_mode", renderGlobalsFn)]);
+    paramArray.insert("sampling_mode", samplingModes[renderGlobals->samplingMode]);
     paramArray.insert("pixel_renderer", "uniform");
     paramArray.insert_path("uniform_pixel_renderer.decorrelate_pixels", true);
     paramArray.insert_path("uniform_pixel_renderer.force_antialiasing", false);
-    paramArray.insert_path("uniform_pixel_renderer.samples", getIntAttr("maxSamples", renderGlobalsFn, 16));
+    paramArray.insert_path("uniform_pixel_renderer.samples", renderGlobals->maxSamples);
 
     paramArray.insert("pixel_renderer", "adaptive");
-    paramArray.insert_path("adaptive_pixel_renderer.enable_diagnostics", getBoolAttr("enable_diagnostics", renderGlobalsFn, true));
-    paramArray.insert_path("adaptive_pixel_renderer.min_samples", getIntAttr("minSamples", renderGlobalsFn, 1));
-    paramArray.insert_path("adaptive_pixel_renderer.max_samples", getIntAttr("maxSamples", renderGlobalsFn, 16));
-    paramArray.insert_path("adaptive_pixel_renderer.quality", getFloatAttr("adaptiveQuality", renderGlobalsFn, 3.0f));
+    paramArray.insert_path("adaptive_pixel_renderer.enable_diagnostics", renderGlobals->enableDiagnostics);
+    paramArray.insert_path("adaptive_pixel_renderer.min_samples", renderGlobals->minSamples);
+    paramArray.insert_path("adaptive_pixel_renderer.max_samples", renderGlobals->maxSamples);
+    paramArray.insert_path("adaptive_pixel_renderer.quality", renderGlobals->adaptiveQuality);
 
-    paramArray.insert_path("generic_frame_renderer.passes", getIntAttr("frameRendererPasses", renderGlobalsFn, 1));
+    paramArray.insert_path("generic_frame_renderer.passes", renderGlobals->frameRendererPasses);
     paramArray.insert_path("generic_frame_renderer.tile_ordering", bucketOrder.asChar());
 
     paramArray.insert("lighting_engine", lightingEngine.asChar());
-    paramArray.insert_path((lightingEngine + ".enable_ibl").asChar(), getBoolAttr("enable_ibl", renderGlobalsFn, true));
-    paramArray.insert_path((lightingEngine + ".enable_dl").asChar(), getBoolAttr("enable_dl", renderGlobalsFn, true));
-    paramArray.insert_path((lightingEngine + ".dl_light_samples").asChar(), getIntAttr("directLightSamples", renderGlobalsFn, 0));
-    paramArray.insert_path((lightingEngine + ".ibl_env_samples").asChar(), getIntAttr("environmentSamples", renderGlobalsFn, 0));
-    paramArray.insert_path((lightingEngine + ".next_event_estimation").asChar(), getBoolAttr("next_event_estimation", renderGlobalsFn, true));
-    paramArray.insert_path((lightingEngine + ".enable_caustics").asChar(), getBoolAttr("enable_caustics", renderGlobalsFn, true));
-    paramArray.insert_path((lightingEngine + ".alpha").asChar(), getFloatAttr("sppmAlpha", renderGlobalsFn, .8f));
+    paramArray.insert_path((lightingEngine + ".enable_ibl").asChar(), renderGlobals->enableIbl);
+    paramArray.insert_path((lightingEngine + ".enable_dl").asChar(), renderGlobals->enableDl);
+    paramArray.insert_path((lightingEngine + ".dl_light_samples").asChar(), renderGlobals->directLightSamples);
+    paramArray.insert_path((lightingEngine + ".ibl_env_samples").asChar(), renderGlobals->environmentSamples);
+    paramArray.insert_path((lightingEngine + ".next_event_estimation").asChar(), renderGlobals->nextEventEstimation);
+    paramArray.insert_path((lightingEngine + ".enable_caustics").asChar(), renderGlobals->enableCaustics);
+    paramArray.insert_path((lightingEngine + ".alpha").asChar(), renderGlobals->sppmAlpha);
     paramArray.insert_path((lightingEngine + ".dl_type").asChar(), dlType.asChar());
-    paramArray.insert_path((lightingEngine + ".env_photons_per_pass").asChar(), getIntAttr("env_photons_per_pass", renderGlobalsFn, 100000));
-    paramArray.insert_path((lightingEngine + ".initial_radius").asChar(), getFloatAttr("initial_radius", renderGlobalsFn, .5f));
-    paramArray.insert_path((lightingEngine + ".light_photons_per_pass").asChar(), getIntAttr("light_photons_per_pass", renderGlobalsFn, 100000));
-    paramArray.insert_path((lightingEngine + ".max_photons_per_estimate").asChar(), getIntAttr("max_photons_per_estimate", renderGlobalsFn, 100));
-    paramArray.insert_path((lightingEngine + ".photons_per_pass").asChar(), getIntAttr("photons_per_pass", renderGlobalsFn, 100000));
-
-    if (getFloatAttr("max_ray_intensity", renderGlobalsFn, .5f) > 0.0)
-        paramArray.insert_path((lightingEngine + ".max_ray_intensity").asChar(), getFloatAttr("max_ray_intensity", renderGlobalsFn, .5f));
+    paramArray.insert_path((lightingEngine + ".env_photons_per_pass").asChar(), renderGlobals->envPhotonsPerPass);
+    paramArray.insert_path((lightingEngine + ".initial_radius").asChar(), renderGlobals->initialRadius);
+    paramArray.insert_path((lightingEngine + ".light_photons_per_pass").asChar(), renderGlobals->lightPhotonsPerPass);
+    paramArray.insert_path((lightingEngine + ".max_photons_per_estimate").asChar(), renderGlobals->maxPhotonsPerEstimate);
+    paramArray.insert_path((lightingEngine + ".photons_per_pass").asChar(), renderGlobals->photonsPerPass);
+
+    if (renderGlobals->maxRayIntensity > 0.0)
+        paramArray.insert_path((lightingEngine + ".max_ray_intensity").asChar(), renderGlobals->maxRayIntensity);
     paramArray.insert_path((lightingEngine + ".photon_type").asChar(), photonType.asChar());
-    paramArray.insert_path((lightingEngine + ".max_path_length").asChar(), getFloatAttr("max_path_length", renderGlobalsFn, 8.0f));
-    paramArray.insert_path((lightingEngine + ".rr_min_path_length").asChar(), getFloatAttr("rr_min_path_length", renderGlobalsFn, 3.0f));
-    paramArray.insert_path((lightingEngine + ".path_tracing_max_path_length").asChar(), getFloatAttr("path_tracing_max_path_length", renderGlobalsFn, 8.0f));
-    paramArray.insert_path((lightingEngine + ".path_tracing_rr_min_path_length").asChar(), getFloatAttr("path_tracing_rr_min_path_length", renderGlobalsFn, 3.0f));
-    paramArray.insert_path((lightingEngine + ".photon_tracing_max_path_length").asChar(), getFloatAttr("photon_tracing_max_path_length", renderGlobalsFn, 8.0f));
-    paramArray.insert_path((lightingEngine + ".photon_tracing_rr_min_path_length").asChar(), getFloatAttr("photon_tracing_rr_min_path_length", renderGlobalsFn, 3.0f));
+    paramArray.insert_path((lightingEngine + ".max_path_length").asChar(), renderGlobals->maxPathLength);
+    paramArray.insert_path((lightingEngine + ".rr_min_path_length").asChar(), renderGlobals->rrMinPathLength);
+    paramArray.insert_path((lightingEngine + ".path_tracing_max_path_length").asChar(), renderGlobals->pathTracingMaxPathLength);
+    paramArray.insert_path((lightingEngine + ".path_tracing_rr_min_path_length").asChar(), renderGlobals->pathTracingRrMinPathLength);
+    paramArray.insert_path((lightingEngine + ".photon_tracing_max_path_length").asChar(), renderGlobals->photonTracingMaxPathLength);
+    paramArray.insert_path((lightingEngine + ".photon_tracing_rr_min_path_length").asChar(), renderGlobals->photonTracingRrMinPathLength);
 }
 
 void AppleseedRenderer::defineConfig()
 {
     Logging::debug("AppleseedRenderer::defineConfig");
-    MFnDependencyNode renderGlobalsFn(getRenderGlobalsNode());
     boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
 
     project->add_default_configurations();
     addRenderParams(project->configurations().get_by_name("final")->get_parameters());
     addRenderParams(project->configurations().get_by_name("interactive")->get_parameters());
 
-    int renderer = getEnumInt("pixel_renderer", renderGlobalsFn);
     const char *pixel_renderers[2] = { "adaptive", "uniform" };
-    const char *pixel_renderer = pixel_renderers[renderer];
+    const char *pixel_renderer = pixel_renderers[renderGlobals->pixelRenderer];
 
     project->configurations()
         .get_by_name("final")->get_parameters()
@@ -433,25 +526,22 @@ void AppleseedRenderer::defineEnvironment()
     MString gradHorizName = "gradientHorizon";
     MString gradZenitName = "gradientZenit";
     MStatus stat;
-    float latlongHoShift = getFloatAttr("latlongHoShift", appleseedGlobals, 0.0f);
-    float latlongVeShift = getFloatAttr("latlongVeShift", appleseedGlobals, 0.0f);
-    int skyModel = getEnumInt("skyModel", appleseedGlobals);
-    int environmentType = getEnumInt("environmentType", appleseedGlobals);
-    float ground_albedo = getFloatAttr("ground_albedo", appleseedGlobals, 0.0f);
-    float horizon_shift = getFloatAttr("horizon_shift", appleseedGlobals, 0.0f);
-    float luminance_multiplier = getFloatAttr("luminance_multiplier", appleseedGlobals, 1.0f);
-    float saturation_multiplier = getFloatAttr("saturation_multiplier", appleseedGlobals, 1.0f);
-    float turbidity = getFloatAttr("turbidity", appleseedGlobals, 2.0f);
-    float turbidity_max = getFloatAttr("turbidity_max", appleseedGlobals, 3.0f);
-    float turbidity_min = getFloatAttr("turbidity_min", appleseedGlobals, 3.0f);
-    int environmentSamples = getIntAttr("environmentSamples", appleseedGlobals, 1);
-    bool physicalSun = getBoolAttr("physicalSun", appleseedGlobals, false);
-    float sunTurbidity = getFloatAttr("sunTurbidity", appleseedGlobals, 3.0f);
-    float sunExitanceMultiplier = getFloatAttr("sunExitanceMultiplier", appleseedGlobals, 1.0f);
-    MColor environmentColorColor = getColorAttr("environmentColor", appleseedGlobals);
-    MColor gradientHorizonColor = getColorAttr("gradientHorizon", appleseedGlobals);
-    MColor gradientZenitColor = getColorAttr("gradientZenit", appleseedGlobals);
-    float environmentIntensity = getFloatAttr("environmentIntensity", appleseedGlobals, 1.0f);
+    boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+    float latlongHoShift = renderGlobals->latlongHoShift;
+    float latlongVeShift = renderGlobals->latlongVeShift;
+    int skyModel = renderGlobals->skyModel;
+    int environmentType = renderGlobals->environmentType;
+    float ground_albedo = renderGlobals->groundAlbedo;
+    float horizon_shift = renderGlobals->horizonShift;
+    float luminance_multiplier = renderGlobals->luminanceMultiplier;
+    float saturation_multiplier = renderGlobals->saturationMultiplier;
+    float turbidity = renderGlobals->turbidity;
+    float turbidity_max = renderGlobals->turbidityMax;
+    float turbidity_min = renderGlobals->turbidityMin;
+    MColor environmentColorColor = renderGlobals->environmentColor;
+    MColor gradientHorizonColor = renderGlobals->gradientHorizon;
+    MColor gradientZenitColor = renderGlobals->gradientZenit;
+    float environmentIntensity = renderGlobals->environmentIntensity;
 
     defineColor(project.get(), envColorName.asChar(), environmentColorColor, environmentIntensity);
     defineColor(project.get(), gradHorizName.asChar(), gradientHorizonColor, environmentIntensity);
@@ -528,8 +618,8 @@ void AppleseedRenderer::defineEnvironment()
         // Physical Sky.
         case 5:
         {
-            double sunTheta = getDoubleAttr("sun_theta", appleseedGlobals, 30.0);
-            double sunPhi = getDoubleAttr("sun_phi", appleseedGlobals, 60.0);
+            double sunTheta = renderGlobals->sunTheta;
+            double sunPhi = renderGlobals->sunPhi;
             MObject connectedNode = getConnectedInNode(getRenderGlobalsNode(), "physicalSunConnection");
 
             if (connectedNode != MObject::kNullObj)
@@ -624,18 +714,6 @@ void AppleseedRenderer::defineEnvironment()
                 .insert("environment_shader", "sky_shader")));
 }
 
-namespace
-{
-    renderer::GVector3 MPointToAppleseed(const MPoint& p)
-    {
-        return
-            renderer::GVector3(
-                static_cast<float>(p.x),
-                static_cast<float>(p.y),
-                static_cast<float>(p.z));
-    }
-}
-
 void AppleseedRenderer::createMesh(boost::shared_ptr<MayaObject> obj)
 {
     // If the mesh has an attribute called "mtap_standin_path" and it contains a valid entry, then try to read the
@@ -643,68 +721,42 @@ void AppleseedRenderer::createMesh(boost::shared_ptr<MayaObject> obj)
     // The other way is to have a standInMeshNode which is connected to the inMesh of the mesh node.
     // In this case, get the standin node, read the path of the binmesh file and load it.
 
-    MStatus stat = MStatus::kSuccess;
-    MFnMesh meshFn(obj->mobject, &stat);
-    CHECK_MSTATUS(stat);
-
-    MPointArray points;
-    MFloatVectorArray normals;
-    MFloatArray uArray, vArray;
-    MIntArray triPointIds, triNormalIds, triUvIds, triMatIds;
-    Logging::debug("defineMesh pre getMeshData");
     obj->getShadingGroups();
-    obj->getMeshData(points, normals, uArray, vArray, triPointIds, triNormalIds, triUvIds, triMatIds);
 
-    MString meshName = getObjectName(obj.get());
+    MeshArrays arrays;
+    readMeshArrays(obj, arrays);
+
+    const MString meshName = getObjectName(obj.get());
     Logging::debug(MString("Translating mesh object ") + meshName);
 
-    // Create a new mesh object.
-    foundation::auto_release_ptr<renderer::MeshObject> mesh = renderer::MeshObjectFactory::create(meshName.asChar(), renderer::ParamArray());
+    size_t degenerateNormalCount;
+    foundation::auto_release_ptr<renderer::MeshObject> mesh(
+        buildMesh(meshName.asChar(), arrays, degenerateNormalCount));
 
-    for (uint vtxId = 0; vtxId < points.length(); vtxId++)
-        mesh->push_vertex(MPointToAppleseed(points[vtxId]));
+    if (degenerateNormalCount > 0)
+        Logging::warning(MString("Malformed normal in ") + obj->shortName);
 
-    for (uint nId = 0; nId < normals.length(); nId++)
-    {
-        MVector n = normals[nId];
-        MStatus s = n.normalize();
-        if (n.length() < .3)
-            n.y = .1;
-        n.normalize();
-        mesh->push_vertex_normal(MPointToAppleseed(n));
-    }
+    insertMesh(obj, mesh);
+}
 
-    for (uint tId = 0; tId < uArray.length(); tId++)
-        mesh->push_tex_coords(renderer::GVector2((float)uArray[tId], (float)vArray[tId]));
+void AppleseedRenderer::readMeshArrays(boost::shared_ptr<MayaObject> obj, MeshArrays& arrays)
+{
+    MStatus stat = MStatus::kSuccess;
+    MObject smoothMeshData;
+    MFnMesh meshFn(getRenderMesh(obj->mobject, smoothMeshData), &stat);
+    CHECK_MSTATUS(stat);
 
-    mesh->reserve_material_slots(obj->shadingGroups.length());
-    for (uint sgId = 0; sgId < obj->shadingGroups.length(); sgId++)
-    {
-        MString slotName = MString("slot") + sgId;
-        mesh->push_material_slot(slotName.asChar());
-    }
+    getMeshArrays(meshFn, obj->perFaceAssignments, obj->shadingGroups.length(), arrays);
 
-    const uint numTris = triPointIds.length() / 3;
+    if (arrays.uvs.empty())
+        Logging::warning(MString("Object has no uv's: ") + obj->shortName);
+}
 
-    for (uint triId = 0; triId < numTris; triId++)
-    {
-        const uint index = triId * 3;
-        const int perFaceShadingGroup = triMatIds[triId];
-        const int vtxId0 = triPointIds[index];
-        const int vtxId1 = triPointIds[index + 1];
-        const int vtxId2 = triPointIds[index + 2];
-        const int normalId0 = triNormalIds[index];
-        const int normalId1 = triNormalIds[index + 1];
-        const int normalId2 = triNormalIds[index + 2];
-        const int uvId0 = triUvIds[index];
-        const int uvId1 = triUvIds[index + 1];
-        const int uvId2 = triUvIds[index + 2];
-        mesh->push_triangle(renderer::Triangle(vtxId0, vtxId1, vtxId2,  normalId0, normalId1, normalId2, uvId0, uvId1, uvId2, perFaceShadingGroup));
-    }
+void AppleseedRenderer::insertMesh(boost::shared_ptr<MayaObject> obj, foundation::auto_release_ptr<renderer::MeshObject> mesh)
+{
+    const MString meshName = mesh->get_name();
 
-    MayaObject* assemblyObject = getAssemblyMayaObject(obj.get());
     renderer::Assembly* ass = getOrCreateAssembly(obj.get());
-    renderer::AssemblyInstance* assInst = getOrCreateAssemblyInstance(obj.get());
     renderer::Object* meshPtr = ass->objects().get_by_name(meshName.asChar());
 
     if (meshPtr != 0)
@@ -715,15 +767,21 @@ void AppleseedRenderer::createMesh(boost::shared_ptr<MayaObject> obj)
     }
 
     ass->objects().insert(foundation::auto_release_ptr<renderer::Object>(mesh));
-    meshPtr = ass->objects().get_by_name(meshName.asChar());
+
+    insertObjectInstance(obj, meshName);
+}
+
+void AppleseedRenderer::insertObjectInstance(boost::shared_ptr<MayaObject> obj, const MString& objectName)
+{
+    MayaObject* assemblyObject = getAssemblyMayaObject(obj.get());
+    renderer::Assembly* ass = getOrCreateAssembly(obj.get());
+    renderer::AssemblyInstance* assInst = getOrCreateAssemblyInstance(obj.get());
 
     MString objectInstanceName = getObjectInstanceName(obj.get());
 
     MMatrix assemblyObjectMatrix = assemblyObject->dagPath.inclusiveMatrix();
     MMatrix objectMatrix = obj->dagPath.inclusiveMatrix();
     MMatrix diffMatrix = objectMatrix * assemblyObjectMatrix.inverse();
-    foundation::Matrix4d appleMatrix;
-    MMatrixToAMatrix(diffMatrix, appleMatrix);
 
     renderer::ParamArray objInstanceParamArray;
     addVisibilityFlags(obj, objInstanceParamArray);
@@ -739,8 +797,8 @@ void AppleseedRenderer::createMesh(boost::shared_ptr<MayaObject> obj)
         renderer::ObjectInstanceFactory::create(
             objectInstanceName.asChar(),
             objInstanceParamArray,
-            meshPtr->get_name(),
-            foundation::Transformd::from_local_to_parent(appleMatrix),
+            objectName.asChar(),
+            MMatrixToTransform(diffMatrix),
             foundation::StringDictionary()));
 }
 
@@ -775,6 +833,8 @@ void AppleseedRenderer::updateGeometry(boost::shared_ptr<MayaObject> mobj)
     if (mobj->instanceNumber == 0)
     {
         createMesh(mobj);
+
+        ScopedPhaseTimer timer("defineProject.geometry.materials");
         defineMaterial(mobj);
     }
 }
@@ -809,15 +869,368 @@ void AppleseedRenderer::updateInstance(boost::shared_ptr<MayaObject> mobj)
     }
 }
 
+namespace
+{
+    // A mesh translated by defineGeometry(). Its data is read from Maya on
+    // the main thread, the appleseed mesh is built on a worker thread unless
+    // it was found in the geometry cache.
+    struct MeshJob
+    {
+        boost::shared_ptr<MayaObject>   obj;
+        std::string                     name;
+        GeometrySignature               signature;
+        MeshArrays                      arrays;
+        renderer::MeshObject*           mesh;
+        size_t                          degenerateNormalCount;
+        foundation::uint64              contentHash;
+        bool                            hashed;
+        size_t                          original;   // index of the job whose mesh is shared, own index if none
+        bool                            deforming;  // the shape may deform while the shutter is open
+        bool                            velocityBlur;
+        std::vector<float>              velocities; // per vertex, in units per second, if velocityBlur is set
+
+        MeshJob()
+          : mesh(0)
+          , degenerateNormalCount(0)
+          , contentHash(0)
+          , hashed(false)
+          , original(0)
+          , deforming(false)
+          , velocityBlur(false)
+        {
+        }
+    };
+
+    // Hands jobs to the workers as soon as the main thread has read their data.
+    class MeshJobQueue
+      : public foundation::NonCopyable
+    {
+      public:
+        explicit MeshJobQueue(std::vector<MeshJob>& jobs)
+          : mJobs(jobs)
+          , mReady(0)
+          , mNext(0)
+        {
+        }
+
+        // Mark the next job as ready to be built.
+        void pushReady()
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            ++mReady;
+            mCondition.notify_one();
+        }
+
+        // Return the next job to build, or 0 once all jobs have been handed out.
+        MeshJob* pop()
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+
+            while (mNext == mReady && mNext < mJobs.size())
+                mCondition.wait(lock);
+
+            return mNext < mJobs.size() ? &mJobs[mNext++] : 0;
+        }
+
+      private:
+        std::vector<MeshJob>&           mJobs;
+        size_t                          mReady;
+        size_t                          mNext;
+        boost::mutex                    mMutex;
+        boost::condition_variable       mCondition;
+    };
+
+    void buildMeshes(MeshJobQueue* queue, const bool hashContent)
+    {
+        while (MeshJob* job = queue->pop())
+        {
+            if (job->mesh != 0)
+                continue;
+
+            job->mesh = buildMesh(job->name.c_str(), job->arrays, job->degenerateNormalCount).release();
+
+            if (hashContent)
+            {
+                job->contentHash = hashMeshContent(*job->mesh);
+                job->hashed = true;
+            }
+
+            // Release the copied Maya data as early as possible.
+            std::vector<float>().swap(job->arrays.points);
+            std::vector<float>().swap(job->arrays.normals);
+            std::vector<float>().swap(job->arrays.uvs);
+            std::vector<std::vector<float> >().swap(job->arrays.pointPoses);
+            std::vector<std::vector<float> >().swap(job->arrays.normalPoses);
+            job->arrays.topology = MeshTopology();
+        }
+    }
+
+    // Point every job whose mesh has the same geometry as the mesh of an
+    // earlier job in the same assembly to that job. Hash collisions are
+    // resolved by comparing the meshes. Return the number of duplicates.
+    size_t findDuplicateMeshes(std::vector<MeshJob>& jobs)
+    {
+        typedef std::pair<const MayaObject*, foundation::uint64> MeshKey;
+        typedef std::multimap<MeshKey, size_t> MeshMap;
+
+        MeshMap meshes;
+        size_t duplicateCount = 0;
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            MeshJob& job = jobs[i];
+
+            if (!job.hashed)
+            {
+                job.contentHash = hashMeshContent(*job.mesh);
+                job.hashed = true;
+            }
+
+            const MeshKey key(getAssemblyMayaObject(job.obj.get()), job.contentHash);
+            const std::pair<MeshMap::const_iterator, MeshMap::const_iterator> range = meshes.equal_range(key);
+
+            for (MeshMap::const_iterator m = range.first; m != range.second; ++m)
+            {
+                if (haveSameContent(*jobs[m->second].mesh, *job.mesh))
+                {
+                    job.original = m->second;
+                    ++duplicateCount;
+                    break;
+                }
+            }
+
+            if (job.original == i)
+                meshes.insert(std::make_pair(key, i));
+        }
+
+        return duplicateCount;
+    }
+
+    bool usesDeformationBlur(const boost::shared_ptr<MayaObject>& mobj)
+    {
+        const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+        return
+            renderGlobals->doMb &&
+            renderGlobals->geotimesamples > 1 &&
+            mobj->motionBlurred;
+    }
+
+    // Times of the geometry motion steps of the current frame.
+    std::vector<MTime> getDeformationTimes()
+    {
+        const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+        std::vector<MTime> times;
+        for (size_t i = 0; i < renderGlobals->mbElementList.size(); ++i)
+        {
+            const MbElement& element = renderGlobals->mbElementList[i];
+            if (element.elementType == MbElement::MotionBlurGeo || element.elementType == MbElement::MotionBlurBoth)
+                times.push_back(MTime(renderGlobals->currentFrameNumber + element.time, MTime::uiUnit()));
+        }
+        return times;
+    }
+
+    // Assembly instances of a particle instancer, created away from the main thread.
+    struct InstanceJob
+    {
+        const InstancerInstances*               instances;
+        const std::vector<std::string>*         assemblyNames;  // per prototype
+        std::string                             namePrefix;
+        size_t                                  begin;
+        size_t                                  end;
+        std::vector<renderer::AssemblyInstance*>* result;
+    };
+
+    void createInstances(const InstanceJob job)
+    {
+        const InstancerInstances& instances = *job.instances;
+
+        for (size_t i = job.begin; i < job.end; ++i)
+        {
+            char suffix[32];
+            sprintf(suffix, "_%u_assInst", static_cast<unsigned int>(i));
+
+            foundation::auto_release_ptr<renderer::AssemblyInstance> assemblyInstance(
+                renderer::AssemblyInstanceFactory::create(
+                    (job.namePrefix + suffix).c_str(),
+                    renderer::ParamArray(),
+                    (*job.assemblyNames)[instances.prototypeIndices[i]].c_str()));
+
+            fillMatrices(&instances.getMatrix(0, i), instances.stepCount, assemblyInstance->transform_sequence());
+
+            (*job.result)[i] = assemblyInstance.release();
+        }
+    }
+
+    bool needsMeshTranslation(const boost::shared_ptr<MayaObject>& mobj)
+    {
+        return
+            !mobj->removed &&
+            mobj->isObjVisible() &&
+            mobj->mobject.hasFn(MFn::kMesh) &&
+            mobj->instanceNumber == 0;
+    }
+}
+
 void AppleseedRenderer::defineGeometry()
 {
     boost::shared_ptr<MayaScene> mayaScene = getWorldPtr()->mScene;
     boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
     std::vector<boost::shared_ptr<MayaObject> >::iterator oIt;
+
+    // Shared meshes would break the interactive updates of individual shapes.
+    const bool deduplicate =
+        renderGlobals->deduplicateMeshes &&
+        getWorldPtr()->getRenderType() != World::IPRRENDER;
+
+    // Meshes are translated in a pipeline: the main thread reads the data of
+    // every mesh out of Maya while worker threads triangulate and build the
+    // appleseed meshes, which are then inserted back on the main thread.
+    // A smooth mesh preview is only generated once if a mesh is read several times.
+    SmoothMeshCacheScope smoothMeshCacheScope;
+    std::vector<MeshJob> jobs;
+    size_t missCount = 0;
     for (oIt = mayaScene->objectList.begin(); oIt != mayaScene->objectList.end(); oIt++)
     {
         boost::shared_ptr<MayaObject> mobj = *oIt;
-        updateGeometry(mobj);
+        if (needsMeshTranslation(mobj))
+        {
+            jobs.push_back(MeshJob());
+            MeshJob& job = jobs.back();
+            job.obj = mobj;
+            job.name = getObjectName(mobj.get()).asChar();
+            job.original = jobs.size() - 1;
+
+            // Shapes with velocities are moved along them, shapes with animated
+            // construction history may deform and are sampled at every geometry
+            // motion step. Static history, e.g. of a modeled mesh, can't deform.
+            if (usesDeformationBlur(mobj))
+            {
+                job.velocityBlur = getMeshVelocities(mobj->mobject, renderGlobals->velocitySources, job.velocities);
+                job.deforming =
+                    job.velocityBlur ||
+                    (mobj->shapeConnected && hasAnimatedHistory(mobj->mobject));
+            }
+
+            // Meshes whose shape didn't change since the previous frame are reused.
+            // The signature only covers the current time, so shapes that may deform
+            // are always rebuilt and never cached.
+            mobj->getShadingGroups();
+            if (!job.deforming)
+            {
+                job.signature = computeGeometrySignature(mobj.get());
+                job.mesh = geometryCache.fetch(mobj.get(), job.signature).release();
+            }
+            if (job.mesh == 0)
+                ++missCount;
+        }
+        else
+            updateGeometry(mobj);
+    }
+
+    if (missCount > 0)
+    {
+        MeshJobQueue queue(jobs);
+        const size_t threadCount = std::min(missCount, static_cast<size_t>(std::max(renderGlobals->threads, 1)));
+        boost::thread_group workers;
+        for (size_t i = 0; i < threadCount; ++i)
+            workers.create_thread(boost::bind(buildMeshes, &queue, deduplicate));
+
+        const std::vector<MTime> deformationTimes = getDeformationTimes();
+        const MTime currentTime(renderGlobals->currentFrameNumber, MTime::uiUnit());
+        std::vector<double> velocityOffsets;
+        for (size_t i = 0; i < deformationTimes.size(); ++i)
+            velocityOffsets.push_back((deformationTimes[i] - currentTime).as(MTime::kSeconds));
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            MeshJob& job = jobs[i];
+            if (job.mesh == 0)
+            {
+                readMeshArrays(job.obj, job.arrays);
+                bool samplePoses = job.deforming;
+                if (job.velocityBlur)
+                {
+                    // E.g. per cage vertex velocities of a smooth mesh preview.
+                    samplePoses = !getVelocityPoses(job.velocities, velocityOffsets, job.arrays);
+                    if (samplePoses)
+                        Logging::warning(MString("Velocities of ") + job.obj->fullName + " don't match the vertices of the rendered mesh, sampling the deformation instead.");
+                    std::vector<float>().swap(job.velocities);
+                }
+
+                if (samplePoses && !getMeshPoses(job.obj->mobject, deformationTimes, job.arrays))
+                    Logging::warning(MString("Topology of ") + job.obj->shortName + " changes while the shutter is open, deformation blur disabled.");
+            }
+            queue.pushReady();
+        }
+
+        workers.join_all();
+    }
+
+    size_t duplicateCount = 0;
+    if (deduplicate)
+    {
+        ScopedPhaseTimer timer("defineProject.geometry.deduplicate");
+        duplicateCount = findDuplicateMeshes(jobs);
+    }
+
+    size_t savedBytes = 0;
+    size_t deformedCount = 0;
+    size_t poseBytes = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        MeshJob& job = jobs[i];
+
+        if (job.degenerateNormalCount > 0)
+            Logging::warning(MString("Malformed normal in ") + job.obj->shortName);
+
+        foundation::auto_release_ptr<renderer::MeshObject> mesh(job.mesh);
+        job.mesh = 0;
+
+        const bool hasPoses = mesh->get_motion_segment_count() > 0;
+        if (hasPoses && job.original == i)
+        {
+            ++deformedCount;
+            poseBytes += getMeshPosesMemorySize(mesh.ref());
+        }
+
+        if (job.original != i)
+        {
+            // Duplicates are instances of the original mesh and are not cached.
+            savedBytes += getMeshMemorySize(mesh.ref());
+            insertObjectInstance(job.obj, jobs[job.original].name.c_str());
+        }
+        else
+        {
+            insertMesh(job.obj, mesh);
+            if (!job.deforming)
+            {
+                geometryCache.record(
+                    job.obj.get(),
+                    job.signature,
+                    getAssembly(job.obj.get())->get_name(),
+                    job.name);
+            }
+        }
+
+        ScopedPhaseTimer timer("defineProject.geometry.materials");
+        defineMaterial(job.obj);
+    }
+
+    if (deduplicate)
+    {
+        Logging::info(
+            MString("Mesh deduplication: ") + static_cast<int>(duplicateCount) + " of " +
+            static_cast<int>(jobs.size()) + " meshes shared, " +
+            foundation::pretty_size(savedBytes).c_str() + " saved (" +
+            foundation::to_string(savedBytes).c_str() + " bytes).");
+    }
+
+    if (deformedCount > 0)
+    {
+        Logging::info(
+            MString("Deformation blur: ") + static_cast<int>(deformedCount) + " meshes with " +
+            static_cast<int>(renderGlobals->geotimesamples) + " keys, " +
+            foundation::pretty_size(poseBytes).c_str() + " used by the additional keys.");
     }
 
     // Create assembly instances.
@@ -827,40 +1240,71 @@ void AppleseedRenderer::defineGeometry()
         updateInstance(mobj);
     }
 
-    for (oIt = mayaScene->instancerNodeElements.begin(); oIt != mayaScene->instancerNodeElements.end(); oIt++)
+    for (size_t i = 0; i < mayaScene->instancerInstances.size(); ++i)
     {
-        boost::shared_ptr<MayaObject> mobj = *oIt;
+        ScopedPhaseTimer timer("defineProject.geometry.instancers");
+        defineInstancerInstances(mayaScene->instancerInstances[i]);
+    }
+}
 
-        if (mobj->dagPath.node().hasFn(MFn::kWorld))
-            continue;
-        if (mobj->instanceNumber == 0)
-            continue;
+void AppleseedRenderer::defineInstancerInstances(const InstancerInstances& instances)
+{
+    const size_t instanceCount = instances.size();
+    if (instanceCount == 0 || instances.stepCount == 0)
+        return;
 
-        MayaObject* assemblyObject = getAssemblyMayaObject(mobj.get());
-        if (assemblyObject == 0)
+    std::vector<std::string> assemblyNames(instances.prototypes.size());
+    for (size_t i = 0; i < instances.prototypes.size(); ++i)
+        assemblyNames[i] = getAssemblyName(instances.prototypes[i]).asChar();
+
+    // Instances are created in parallel in contiguous ranges and inserted afterwards.
+    const size_t MinInstancesPerThread = 1000;
+    const size_t maxThreadCount = static_cast<size_t>(std::max(getWorldPtr()->mRenderGlobals->threads, 1));
+    const size_t threadCount = std::max<size_t>(std::min(maxThreadCount, instanceCount / MinInstancesPerThread), 1);
+
+    std::vector<renderer::AssemblyInstance*> assemblyInstances(instanceCount, 0);
+
+    InstanceJob job;
+    job.instances = &instances;
+    job.assemblyNames = &assemblyNames;
+    job.namePrefix = instances.instancer->fullNiceName.asChar();
+    job.result = &assemblyInstances;
+
+    if (threadCount == 1)
+    {
+        job.begin = 0;
+        job.end = instanceCount;
+        createInstances(job);
+    }
+    else
+    {
+        boost::thread_group workers;
+        for (size_t i = 0; i < threadCount; ++i)
         {
-            Logging::debug("create mesh assemblyPtr == null");
-            continue;
+            job.begin = instanceCount * i / threadCount;
+            job.end = instanceCount * (i + 1) / threadCount;
+            workers.create_thread(boost::bind(createInstances, job));
         }
+        workers.join_all();
+    }
 
-        MString assemblyName = getAssemblyName(assemblyObject);
-        MString assemblyInstanceName = getAssemblyInstanceName(mobj.get());
+    renderer::Assembly* master = getMasterAssemblyFromProject(project.get());
+    for (size_t i = 0; i < instanceCount; ++i)
+        master->assembly_instances().insert(foundation::auto_release_ptr<renderer::AssemblyInstance>(assemblyInstances[i]));
 
-        foundation::auto_release_ptr<renderer::AssemblyInstance> assemblyInstance(
-            renderer::AssemblyInstanceFactory::create(
-            assemblyInstanceName.asChar(),
-            renderer::ParamArray(),
-            assemblyName.asChar()));
-        renderer::TransformSequence &ts = assemblyInstance->transform_sequence();
-        fillMatrices(mobj.get(), ts);
-        getMasterAssemblyFromProject(project.get())->assembly_instances().insert(assemblyInstance);
-    }
+    Logging::info(
+        MString("Instancer ") + instances.instancer->shortName + ": " +
+        static_cast<int>(instanceCount) + " instances, " + static_cast<int>(threadCount) + " threads.");
 }
 
 void AppleseedRenderer::applyInteractiveUpdates(const MayaScene::EditableElementContainer& editableElements)
 {
     boost::shared_ptr<MayaScene> mayaScene = getWorldPtr()->mScene;
 
+    // any of the dirty nodes can change the visibility of the objects below it
+    MayaObject::invalidateVisibility();
+    SmoothMeshCacheScope smoothMeshCacheScope;
+
     for (MayaScene::EditableElementContainer::const_iterator
             i = mayaScene->editableElements.begin(),
             e = mayaScene->editableElements.end(); i != e; ++i)
@@ -892,7 +1336,10 @@ void AppleseedRenderer::applyInteractiveUpdates(const MayaScene::EditableElement
 
             // appleseedGlobals node.
             if (MFnDependencyNode(i->second.node).typeId().id() == APPLESEED_GLOBALS_ID)
+            {
+                getWorldPtr()->mRenderGlobals->getEnvironmentSettings();
                 defineEnvironment();
+            }
 
             if (i->second.node.hasFn(MFn::kMesh))
             {
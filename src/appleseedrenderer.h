@@ -30,6 +30,7 @@
 #define APPLESEEDRENDERER_H
 
 // appleseed-maya headers.
+#include "geometrycache.h"
 #include "mayascene.h"
 #include "renderercontroller.h"
 #include "tilecallback.h"
@@ -78,6 +79,7 @@
 
 // Forward declarations.
 class MayaObject;
+struct MeshArrays;
 class MObject;
 class mtap_MayaScene;
 class mtap_RenderGlobals;
@@ -109,10 +111,8 @@ class AppleseedRenderer
     // This method is called at the end of rendering.
     void unInitializeRenderer();
 
-    // This method is called during scene updating. If a renderer can update motionblur steps on the fly,
-    // the geometry is defined at the very first step and later this definition will be updated for every motion step.
-    // Other renderers will need a complete definition of all motionblur steps at once, so the motion steps will be
-    // in the geometry e.g. with obj->addMeshData(); and at the very last step, everything is defined.
+    // This method is called during scene updating. Deformation motion steps are not collected here,
+    // they are read from the mesh at the motion step times or derived from its velocities in defineGeometry().
     void updateShape(boost::shared_ptr<MayaObject> obj);
 
     // This method is necessary only if the renderer is able to update the transform definition interactively.
@@ -121,6 +121,10 @@ class AppleseedRenderer
 
     void abortRendering();
 
+    // Apply a changed render region to the frame and the tile callbacks.
+    // Must not be called while rendering.
+    void updateRenderRegion();
+
     // Apply updates to the scene.
     void applyInteractiveUpdates(const MayaScene::EditableElementContainer& editableElements);
 
@@ -130,6 +134,10 @@ class AppleseedRenderer
     void defineOutput();
     void createMesh(boost::shared_ptr<MayaObject> obj, renderer::MeshObjectArray& meshArray, bool& isProxyArray);
     void createMesh(boost::shared_ptr<MayaObject> obj);
+    void readMeshArrays(boost::shared_ptr<MayaObject> obj, MeshArrays& arrays); // must be called from the main thread, after obj->getShadingGroups()
+    void insertMesh(boost::shared_ptr<MayaObject> obj, foundation::auto_release_ptr<renderer::MeshObject> mesh);
+    void insertObjectInstance(boost::shared_ptr<MayaObject> obj, const MString& objectName);
+    void defineInstancerInstances(const InstancerInstances& instances);
     renderer::Project *getProjectPtr(){ return this->project.get(); }
     foundation::StringArray defineMaterial(boost::shared_ptr<MayaObject> obj);
     void updateMaterial(MObject sufaceShader);
@@ -142,6 +150,7 @@ class AppleseedRenderer
     std::auto_ptr<foundation::ILogTarget> log_target;
     foundation::auto_release_ptr<TileCallbackFactory> tileCallbackFac;
     RendererController mRendererController;
+    GeometryCache geometryCache;
     bool sceneBuilt;
 };
 
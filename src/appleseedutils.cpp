@@ -45,6 +45,10 @@
 #include "renderer/api/bsdf.h"
 #include "renderer/api/texture.h"
 
+// Standard headers.
+#include <algorithm>
+#include <vector>
+
 void defineDefaultMaterial(renderer::Project* project)
 {
     renderer::Assembly *assembly = getMasterAssemblyFromProject(project);
@@ -148,13 +152,11 @@ void defineMasterAssembly(renderer::Project* project)
     {
         foundation::auto_release_ptr<renderer::Assembly> assembly(renderer::AssemblyFactory().create("world", renderer::ParamArray()));
         getSceneFromProject(project)->assemblies().insert(assembly);
-        foundation::Matrix4d appMatrix;
         MMatrix transformMatrix;
         transformMatrix.setToIdentity();
         transformMatrix *= conversionMatrix;
         foundation::auto_release_ptr<renderer::AssemblyInstance> assemblyInstance = renderer::AssemblyInstanceFactory::create("world_Inst", renderer::ParamArray(), "world");
-        MMatrixToAMatrix(transformMatrix, appMatrix);
-        assemblyInstance->transform_sequence().set_transform(0.0, foundation::Transformd::from_local_to_parent(appMatrix));
+        assemblyInstance->transform_sequence().set_transform(0.0, MMatrixToTransform(transformMatrix));
         getSceneFromProject(project)->assembly_instances().insert(assemblyInstance);
     }
 }
@@ -383,84 +385,128 @@ MString defineTexture(MFnDependencyNode& shader, MString& attributeName)
     return textureInstanceName;
 }
 
-void fillTransformMatrices(MMatrix matrix, renderer::AssemblyInstance* assInstance)
+void fillTransformMatrices(const MMatrix& matrix, renderer::AssemblyInstance* assInstance)
 {
     assInstance->transform_sequence().clear();
-    foundation::Matrix4d appMatrix;
-    MMatrix colMatrix = matrix;
-    MMatrixToAMatrix(colMatrix, appMatrix);
-    assInstance->transform_sequence().set_transform(
-        0.0f,
-        foundation::Transformd::from_local_to_parent(appMatrix));
+    assInstance->transform_sequence().set_transform(0.0f, MMatrixToTransform(matrix));
 }
 
 void fillMatrices(const MayaObject* obj, renderer::TransformSequence& transformSequence)
 {
-    MMatrix conversionMatrix = getWorldPtr()->mRenderGlobals->globalConversionMatrix;
-    float scaleFactor = getWorldPtr()->mRenderGlobals->scaleFactor;
-    transformSequence.clear();
-    std::vector<MMatrix> transformMatrices;
-
     // In IPR mode we have to update the matrix from the dagPath
     if (getWorldPtr()->getRenderType() == World::IPRRENDER && !obj->isInstancerObject)
     {
-        transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
+        const MMatrix matrix = obj->dagPath.inclusiveMatrix();
+        fillMatrices(&matrix, 1, transformSequence);
+        return;
     }
-    else
+
+    const std::vector<MMatrix>& transformMatrices = obj->transformMatrices;
+    if (transformMatrices.empty())
     {
-        transformMatrices = obj->transformMatrices;
+        transformSequence.clear();
+        return;
     }
-    size_t numSteps = transformMatrices.size();
-    size_t divSteps = numSteps;
-    if (divSteps > 1)
-        divSteps -= 1;
-    float stepSize = 1.0f / (float)divSteps;
-    float start = 0.0f;
 
     // cameras pos has to be scaled because it is not placed into the world assembly but directly in the scene.
     // We only scale the transform because a scaled camera will result in different renderings (e.g. dof)
-    foundation::Matrix4d appMatrix;
-    MMatrix transformMatrix;
-    for (size_t matrixId = 0; matrixId < numSteps; matrixId++)
+    if (obj->mobject.hasFn(MFn::kCamera))
     {
-        MMatrix colMatrix = transformMatrices[matrixId];
-        if (obj->mobject.hasFn(MFn::kCamera))
+        const float scaleFactor = getWorldPtr()->mRenderGlobals->scaleFactor;
+        std::vector<MMatrix> scaledMatrices(transformMatrices);
+        for (size_t matrixId = 0; matrixId < scaledMatrices.size(); matrixId++)
         {
-            colMatrix.matrix[3][0] *= scaleFactor;
-            colMatrix.matrix[3][1] *= scaleFactor;
-            colMatrix.matrix[3][2] *= scaleFactor;
+            scaledMatrices[matrixId].matrix[3][0] *= scaleFactor;
+            scaledMatrices[matrixId].matrix[3][1] *= scaleFactor;
+            scaledMatrices[matrixId].matrix[3][2] *= scaleFactor;
         }
-        MMatrixToAMatrix(colMatrix, appMatrix);
-        transformSequence.set_transform(
-            start + stepSize * matrixId,
-            foundation::Transformd::from_local_to_parent(appMatrix));
+        fillMatrices(&scaledMatrices[0], scaledMatrices.size(), transformSequence);
+        return;
     }
+
+    fillMatrices(&transformMatrices[0], transformMatrices.size(), transformSequence);
+}
+
+void fillMatrices(const MMatrix* matrices, const size_t count, renderer::TransformSequence& transformSequence)
+{
+    transformSequence.clear();
+
+    size_t divSteps = count;
+    if (divSteps > 1)
+        divSteps -= 1;
+    const float stepSize = 1.0f / (float)divSteps;
+
+    for (size_t i = 0; i < count; i++)
+        transformSequence.set_transform(stepSize * i, MMatrixToTransform(matrices[i]));
 }
 
 void fillTransformMatrices(const MayaObject* obj, renderer::Light* light)
 {
-    std::vector<MMatrix> transformMatrices;
     // in ipr mode we have to update the matrix manually
     if (getWorldPtr()->getRenderType() == World::IPRRENDER)
-    {
-        transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
-    } 
+        light->set_transform(MMatrixToTransform(obj->dagPath.inclusiveMatrix()));
     else
-    {
-        transformMatrices = obj->transformMatrices;
-    }
-    foundation::Matrix4d appMatrix;
-    MMatrix colMatrix = transformMatrices[0];
-    MMatrixToAMatrix(colMatrix, appMatrix);
-    light->set_transform(foundation::Transformd::from_local_to_parent(appMatrix));
+        light->set_transform(MMatrixToTransform(obj->transformMatrices[0]));
 }
 
-void MMatrixToAMatrix(MMatrix& mayaMatrix, foundation::Matrix4d& appleMatrix)
+void MMatrixToAMatrix(const MMatrix& mayaMatrix, foundation::Matrix4d& appleMatrix)
 {
-    MMatrix rowMatrix = mayaMatrix.transpose();
+    // Maya uses row vectors, appleseed column vectors.
     for (int i = 0; i < 4; i++)
         for (int k = 0; k < 4; k++)
-            appleMatrix[i * 4 + k] = rowMatrix[i][k];
+            appleMatrix[i * 4 + k] = mayaMatrix.matrix[k][i];
+}
+
+namespace
+{
+    // Invert a matrix whose last row is (0, 0, 0, 1) through the inverse of its
+    // upper 3x3 part. Return false if the matrix is singular.
+    bool invertAffine(const foundation::Matrix4d& m, foundation::Matrix4d& inv)
+    {
+        const double c00 = m[5] * m[10] - m[6] * m[9];
+        const double c01 = m[2] * m[9] - m[1] * m[10];
+        const double c02 = m[1] * m[6] - m[2] * m[5];
+        const double c10 = m[6] * m[8] - m[4] * m[10];
+        const double c11 = m[0] * m[10] - m[2] * m[8];
+        const double c12 = m[2] * m[4] - m[0] * m[6];
+        const double c20 = m[4] * m[9] - m[5] * m[8];
+        const double c21 = m[1] * m[8] - m[0] * m[9];
+        const double c22 = m[0] * m[5] - m[1] * m[4];
+
+        const double det = m[0] * c00 + m[1] * c10 + m[2] * c20;
+        if (det == 0.0)
+            return false;
+
+        const double rcpDet = 1.0 / det;
+        inv[0] = c00 * rcpDet;  inv[1] = c01 * rcpDet;  inv[2] = c02 * rcpDet;
+        inv[4] = c10 * rcpDet;  inv[5] = c11 * rcpDet;  inv[6] = c12 * rcpDet;
+        inv[8] = c20 * rcpDet;  inv[9] = c21 * rcpDet;  inv[10] = c22 * rcpDet;
+
+        inv[3] = -(inv[0] * m[3] + inv[1] * m[7] + inv[2] * m[11]);
+        inv[7] = -(inv[4] * m[3] + inv[5] * m[7] + inv[6] * m[11]);
+        inv[11] = -(inv[8] * m[3] + inv[9] * m[7] + inv[10] * m[11]);
+
+        inv[12] = 0.0;  inv[13] = 0.0;  inv[14] = 0.0;  inv[15] = 1.0;
+
+        return true;
+    }
+
+    bool isAffine(const foundation::Matrix4d& m)
+    {
+        return m[12] == 0.0 && m[13] == 0.0 && m[14] == 0.0 && m[15] == 1.0;
+    }
+}
+
+foundation::Transformd MMatrixToTransform(const MMatrix& matrix)
+{
+    foundation::Matrix4d localToParent;
+    MMatrixToAMatrix(matrix, localToParent);
+
+    foundation::Matrix4d parentToLocal;
+    if (isAffine(localToParent) && invertAffine(localToParent, parentToLocal))
+        return foundation::Transformd(localToParent, parentToLocal);
+
+    return foundation::Transformd::from_local_to_parent(localToParent);
 }
 
 void addVisibilityFlags(boost::shared_ptr<MayaObject> obj, renderer::ParamArray& paramArray)
@@ -30,6 +30,7 @@
 #define APPLESEEDUTILS_H
 
 #include "foundation/math/matrix.h"
+#include "foundation/math/transform.h"
 
 #include "renderer/api/light.h"
 #include "renderer/api/project.h"
@@ -58,11 +59,16 @@ renderer::Assembly* createAssembly(const MayaObject* obj);
 renderer::AssemblyInstance* getAssemblyInstance(const MayaObject* obj);
 renderer::AssemblyInstance* getOrCreateAssemblyInstance(const MayaObject* obj);
 renderer::AssemblyInstance* createAssemblyInstance(const MayaObject* obj);
-void MMatrixToAMatrix(MMatrix& mayaMatrix, foundation::Matrix4d& appleMatrix);
+void MMatrixToAMatrix(const MMatrix& mayaMatrix, foundation::Matrix4d& appleMatrix);
+
+// Convert a Maya matrix to an appleseed transform. The inverse of an affine matrix is computed
+// directly instead of through a general 4x4 inversion. Doesn't access Maya.
+foundation::Transformd MMatrixToTransform(const MMatrix& matrix);
 
 void fillTransformMatrices(const MayaObject* obj, renderer::Light* assInstance);
-void fillTransformMatrices(MMatrix matrix, renderer::AssemblyInstance* assInstance);
+void fillTransformMatrices(const MMatrix& matrix, renderer::AssemblyInstance* assInstance);
 void fillMatrices(const MayaObject* obj, renderer::TransformSequence& transformSequence);
+void fillMatrices(const MMatrix* matrices, const size_t count, renderer::TransformSequence& transformSequence); // doesn't access Maya
 
 void defineColor(renderer::Project* project, const char* name, const MColor color, const float intensity, MString colorSpace = "srgb");
 MString colorOrMap(renderer::Project* project, MFnDependencyNode& shaderNode, MString& attributeName);
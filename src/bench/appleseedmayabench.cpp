@@ -0,0 +1,480 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+//
+// Headless benchmark of the Maya-independent hot paths of the plugin:
+// tile to display conversion, render event queue throughput and mesh file
+// writing. Results are printed to stdout as one JSON object per line.
+//
+// Usage: appleseedmaya_bench [--width N] [--height N] [--tile N] [--iterations N]
+//                            [--producers N] [--events N] [--grid N] [--output DIR]
+//
+
+// appleseed-maya headers.
+#include "utilities/mpscringbuffer.h"
+#include "utilities/pixelconversion.h"
+
+// appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/image.h"
+#include "foundation/image/pixel.h"
+#include "foundation/image/tile.h"
+#include "foundation/math/vector.h"
+#include "foundation/mesh/genericmeshfilewriter.h"
+#include "foundation/mesh/imeshwalker.h"
+#include "foundation/platform/compiler.h"
+#include "foundation/platform/timers.h"
+#include "foundation/utility/stopwatch.h"
+
+// Boost headers.
+#include "boost/atomic/atomic.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef foundation::Stopwatch<foundation::DefaultWallclockTimer> Stopwatch;
+
+    struct Settings
+    {
+        size_t      width;
+        size_t      height;
+        size_t      tileSize;
+        size_t      iterations;
+        size_t      producers;
+        size_t      events;
+        size_t      grid;
+        std::string outputDir;
+
+        Settings()
+          : width(1920)
+          , height(1080)
+          , tileSize(64)
+          , iterations(20)
+          , producers(4)
+          , events(200000)
+          , grid(512)
+          , outputDir(".")
+        {
+        }
+    };
+
+    bool parseSettings(int argc, char* argv[], Settings& settings)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+
+            if (arg == "--output" && i + 1 < argc)
+            {
+                settings.outputDir = argv[++i];
+                continue;
+            }
+
+            size_t* value = 0;
+            if (arg == "--width")
+                value = &settings.width;
+            else if (arg == "--height")
+                value = &settings.height;
+            else if (arg == "--tile")
+                value = &settings.tileSize;
+            else if (arg == "--iterations")
+                value = &settings.iterations;
+            else if (arg == "--producers")
+                value = &settings.producers;
+            else if (arg == "--events")
+                value = &settings.events;
+            else if (arg == "--grid")
+                value = &settings.grid;
+
+            if (value == 0 || i + 1 >= argc)
+            {
+                fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+                return false;
+            }
+
+            const long parsed = strtol(argv[++i], 0, 10);
+            if (parsed <= 0)
+            {
+                fprintf(stderr, "Invalid value for %s: %s\n", arg.c_str(), argv[i]);
+                return false;
+            }
+
+            *value = static_cast<size_t>(parsed);
+        }
+
+        return true;
+    }
+
+    //
+    // Tile to display conversion.
+    //
+
+    void fillImage(foundation::Image& image)
+    {
+        const foundation::CanvasProperties& props = image.properties();
+
+        // Values slightly outside of [0, 1] so that saturation does some work.
+        unsigned int seed = 1;
+        for (size_t ty = 0; ty < props.m_tile_count_y; ++ty)
+        {
+            for (size_t tx = 0; tx < props.m_tile_count_x; ++tx)
+            {
+                foundation::Tile& tile = image.tile(tx, ty);
+                float* pixels = reinterpret_cast<float*>(tile.get_storage());
+                const size_t count = tile.get_pixel_count() * 4;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    seed = seed * 1664525u + 1013904223u;
+                    pixels[i] = static_cast<float>(seed >> 8) / (1 << 24) * 1.2f - 0.1f;
+                }
+            }
+        }
+    }
+
+    void benchTileConversion(const Settings& settings, const bool saturate)
+    {
+        foundation::Image image(
+            settings.width,
+            settings.height,
+            settings.tileSize,
+            settings.tileSize,
+            4,
+            foundation::PixelFormatFloat);
+        fillImage(image);
+
+        const foundation::CanvasProperties& props = image.properties();
+        std::vector<float> display(props.m_pixel_count * 4);
+
+        Stopwatch stopwatch;
+        stopwatch.start();
+
+        for (size_t i = 0; i < settings.iterations; ++i)
+        {
+            for (size_t ty = 0; ty < props.m_tile_count_y; ++ty)
+            {
+                for (size_t tx = 0; tx < props.m_tile_count_x; ++tx)
+                {
+                    // Same layout as the render view: bottom-up rows.
+                    const foundation::Tile& tile = image.tile(tx, ty);
+                    const size_t bottom = props.m_canvas_height - ty * props.m_tile_height - tile.get_height();
+                    const size_t index = bottom * props.m_canvas_width + tx * props.m_tile_width;
+                    convertTileToDisplay(tile, &display[index * 4], props.m_canvas_width * 4, saturate);
+                }
+            }
+        }
+
+        const double seconds = stopwatch.measure().get_seconds();
+        const double bytes = static_cast<double>(props.m_pixel_count) * 4 * sizeof(float) * settings.iterations;
+
+        printf(
+            "{\"benchmark\": \"tile_conversion\", \"kernel\": \"%s\", \"saturate\": %s, "
+            "\"width\": %u, \"height\": %u, \"tile_size\": %u, \"iterations\": %u, "
+            "\"seconds\": %.6f, \"gb_per_second\": %.3f}\n",
+            getPixelConversionKernelName(),
+            saturate ? "true" : "false",
+            static_cast<unsigned int>(settings.width),
+            static_cast<unsigned int>(settings.height),
+            static_cast<unsigned int>(settings.tileSize),
+            static_cast<unsigned int>(settings.iterations),
+            seconds,
+            seconds > 0.0 ? bytes / seconds * 1.0e-9 : 0.0);
+    }
+
+    //
+    // Render event queue throughput.
+    //
+
+    // Stand-in for Event: a few fields and an owned buffer, swapped in and out.
+    struct BenchEvent
+    {
+        size_t              producer;
+        size_t              index;
+        std::vector<float>  pixels;
+
+        BenchEvent()
+          : producer(0)
+          , index(0)
+        {
+        }
+
+        void swap(BenchEvent& other)
+        {
+            std::swap(producer, other.producer);
+            std::swap(index, other.index);
+            pixels.swap(other.pixels);
+        }
+    };
+
+    void swap(BenchEvent& lhs, BenchEvent& rhs)
+    {
+        lhs.swap(rhs);
+    }
+
+    typedef MPSCRingBuffer<BenchEvent> BenchQueue;
+
+    void producerMain(
+        BenchQueue*                 queue,
+        boost::atomic<size_t>*      finished,
+        const size_t                producer,
+        const size_t                count)
+    {
+        // Most events are droppable, like progressive tile updates of 64 tiles per producer.
+        for (size_t i = 0; i < count; ++i)
+        {
+            BenchEvent e;
+            e.producer = producer;
+            e.index = i;
+            queue->push(e, i % 3 != 0, producer * 64 + i % 64);
+        }
+
+        finished->fetch_add(1);
+    }
+
+    void benchEventQueue(const Settings& settings, const BenchQueue::BackpressurePolicy policy)
+    {
+        static const char* PolicyNames[] = { "block", "drop", "coalesce" };
+
+        BenchQueue queue(4096);
+        queue.setPolicy(policy);
+
+        const size_t eventsPerProducer = settings.events / settings.producers;
+
+        Stopwatch stopwatch;
+        stopwatch.start();
+
+        boost::atomic<size_t> finished(0);
+        boost::thread_group producers;
+        for (size_t i = 0; i < settings.producers; ++i)
+            producers.create_thread(boost::bind(producerMain, &queue, &finished, i, eventsPerProducer));
+
+        // Consume on this thread, as the UI thread does, until all producers
+        // are done and the queue is drained.
+        size_t consumed = 0;
+        BenchEvent e;
+        while (true)
+        {
+            const bool producersDone = finished.load() == settings.producers;
+
+            while (queue.tryPop(e))
+                ++consumed;
+
+            if (producersDone)
+                break;
+        }
+
+        producers.join_all();
+
+        const double seconds = stopwatch.measure().get_seconds();
+        const BenchQueue::Stats stats = queue.getStats();
+
+        printf(
+            "{\"benchmark\": \"event_queue\", \"policy\": \"%s\", \"producers\": %u, "
+            "\"events\": %u, \"consumed\": %u, \"seconds\": %.6f, \"events_per_second\": %.0f, "
+            "\"contended\": %u, \"blocked\": %u, \"dropped\": %u, \"coalesced\": %u, \"high_water\": %u}\n",
+            PolicyNames[policy],
+            static_cast<unsigned int>(settings.producers),
+            static_cast<unsigned int>(eventsPerProducer * settings.producers),
+            static_cast<unsigned int>(consumed),
+            seconds,
+            seconds > 0.0 ? consumed / seconds : 0.0,
+            static_cast<unsigned int>(stats.contended),
+            static_cast<unsigned int>(stats.blocked),
+            static_cast<unsigned int>(stats.dropped),
+            static_cast<unsigned int>(stats.coalesced),
+            static_cast<unsigned int>(stats.highWater));
+    }
+
+    //
+    // Mesh file writing.
+    //
+
+    // A flat grid of quads with normals and texture coordinates.
+    class GridMeshWalker
+      : public foundation::IMeshWalker
+    {
+      public:
+        explicit GridMeshWalker(const size_t cells)
+          : mCells(cells)
+        {
+        }
+
+        virtual const char* get_name() const APPLESEED_OVERRIDE
+        {
+            return "grid";
+        }
+
+        virtual size_t get_vertex_count() const APPLESEED_OVERRIDE
+        {
+            return (mCells + 1) * (mCells + 1);
+        }
+
+        virtual foundation::Vector3d get_vertex(const size_t i) const APPLESEED_OVERRIDE
+        {
+            const foundation::Vector2d uv = get_tex_coords(i);
+            return foundation::Vector3d(uv.x, 0.0, uv.y);
+        }
+
+        virtual size_t get_vertex_normal_count() const APPLESEED_OVERRIDE
+        {
+            return 1;
+        }
+
+        virtual foundation::Vector3d get_vertex_normal(const size_t i) const APPLESEED_OVERRIDE
+        {
+            return foundation::Vector3d(0.0, 1.0, 0.0);
+        }
+
+        virtual size_t get_tex_coords_count() const APPLESEED_OVERRIDE
+        {
+            return get_vertex_count();
+        }
+
+        virtual foundation::Vector2d get_tex_coords(const size_t i) const APPLESEED_OVERRIDE
+        {
+            return foundation::Vector2d(
+                static_cast<double>(i % (mCells + 1)) / mCells,
+                static_cast<double>(i / (mCells + 1)) / mCells);
+        }
+
+        virtual size_t get_material_slot_count() const APPLESEED_OVERRIDE
+        {
+            return 1;
+        }
+
+        virtual const char* get_material_slot(const size_t i) const APPLESEED_OVERRIDE
+        {
+            return "default";
+        }
+
+        virtual size_t get_face_count() const APPLESEED_OVERRIDE
+        {
+            return mCells * mCells;
+        }
+
+        virtual size_t get_face_vertex_count(const size_t face_index) const APPLESEED_OVERRIDE
+        {
+            return 4;
+        }
+
+        virtual size_t get_face_vertex(const size_t face_index, const size_t vertex_index) const APPLESEED_OVERRIDE
+        {
+            static const size_t OffsetX[] = { 0, 1, 1, 0 };
+            static const size_t OffsetY[] = { 0, 0, 1, 1 };
+            const size_t x = face_index % mCells + OffsetX[vertex_index];
+            const size_t y = face_index / mCells + OffsetY[vertex_index];
+            return y * (mCells + 1) + x;
+        }
+
+        virtual size_t get_face_vertex_normal(const size_t face_index, const size_t vertex_index) const APPLESEED_OVERRIDE
+        {
+            return 0;
+        }
+
+        virtual size_t get_face_tex_coords(const size_t face_index, const size_t vertex_index) const APPLESEED_OVERRIDE
+        {
+            return get_face_vertex(face_index, vertex_index);
+        }
+
+        virtual size_t get_face_material(const size_t face_index) const APPLESEED_OVERRIDE
+        {
+            return 0;
+        }
+
+      private:
+        const size_t mCells;
+    };
+
+    size_t getFileSize(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == 0)
+            return 0;
+
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file);
+        fclose(file);
+
+        return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+
+    void benchMeshWriting(const Settings& settings, const char* extension)
+    {
+        const std::string path = settings.outputDir + "/appleseedmaya_bench." + extension;
+        const GridMeshWalker walker(settings.grid);
+
+        Stopwatch stopwatch;
+        stopwatch.start();
+
+        {
+            foundation::GenericMeshFileWriter writer(path.c_str());
+            writer.write(walker);
+        }
+
+        const double seconds = stopwatch.measure().get_seconds();
+        const size_t bytes = getFileSize(path);
+        remove(path.c_str());
+
+        printf(
+            "{\"benchmark\": \"mesh_writing\", \"format\": \"%s\", \"faces\": %u, "
+            "\"bytes\": %u, \"seconds\": %.6f, \"faces_per_second\": %.0f, \"mb_per_second\": %.3f}\n",
+            extension,
+            static_cast<unsigned int>(walker.get_face_count()),
+            static_cast<unsigned int>(bytes),
+            seconds,
+            seconds > 0.0 ? walker.get_face_count() / seconds : 0.0,
+            seconds > 0.0 ? bytes / seconds * 1.0e-6 : 0.0);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if (!parseSettings(argc, argv, settings))
+        return 1;
+
+    benchTileConversion(settings, false);
+    benchTileConversion(settings, true);
+
+    benchEventQueue(settings, BenchQueue::Block);
+    benchEventQueue(settings, BenchQueue::Drop);
+    benchEventQueue(settings, BenchQueue::Coalesce);
+
+    benchMeshWriting(settings, "binarymesh");
+    benchMeshWriting(settings, "obj");
+
+    return 0;
+}
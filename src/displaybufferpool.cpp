@@ -0,0 +1,114 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "displaybufferpool.h"
+
+// appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+
+namespace
+{
+    // Enough free tile buffers to cover a few hundred queued tiles.
+    const size_t MaxFreeTileBuffers = 256;
+}
+
+DisplayBufferPool::DisplayBufferPool()
+{
+    mTiles.capacity = 0;
+    mTiles.maxFree = MaxFreeTileBuffers;
+}
+
+DisplayBufferPool::~DisplayBufferPool()
+{
+    clear(mTiles);
+}
+
+boost::shared_ptr<RV_PIXEL> DisplayBufferPool::acquireTile(const foundation::CanvasProperties& props)
+{
+    return acquire(mTiles, props.m_tile_width * props.m_tile_height);
+}
+
+boost::shared_ptr<RV_PIXEL> DisplayBufferPool::acquire(Slab& slab, const size_t capacity)
+{
+    RV_PIXEL* pixels = 0;
+
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+
+        // The frame size changed, buffers of the old size are useless now.
+        if (slab.capacity != capacity)
+        {
+            clear(slab);
+            slab.capacity = capacity;
+        }
+
+        if (!slab.freeList.empty())
+        {
+            pixels = slab.freeList.back();
+            slab.freeList.pop_back();
+        }
+    }
+
+    if (pixels == 0)
+        pixels = new RV_PIXEL[capacity];
+
+    Releaser releaser;
+    releaser.pool = shared_from_this();
+    releaser.capacity = capacity;
+
+    return boost::shared_ptr<RV_PIXEL>(pixels, releaser);
+}
+
+void DisplayBufferPool::release(RV_PIXEL* pixels, const size_t capacity)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+
+        if (capacity == mTiles.capacity && mTiles.freeList.size() < mTiles.maxFree)
+        {
+            mTiles.freeList.push_back(pixels);
+            return;
+        }
+    }
+
+    delete [] pixels;
+}
+
+void DisplayBufferPool::clear(Slab& slab)
+{
+    for (size_t i = 0; i < slab.freeList.size(); ++i)
+        delete [] slab.freeList[i];
+
+    slab.freeList.clear();
+}
+
+void DisplayBufferPool::Releaser::operator()(RV_PIXEL* pixels) const
+{
+    pool->release(pixels, capacity);
+}
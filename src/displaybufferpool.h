@@ -0,0 +1,97 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef DISPLAYBUFFERPOOL_H
+#define DISPLAYBUFFERPOOL_H
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+
+// Maya headers.
+#include <maya/MRenderView.h>
+
+// Boost headers.
+#include "boost/enable_shared_from_this.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+
+// Standard headers.
+#include <cstddef>
+#include <vector>
+
+// Forward declarations.
+namespace foundation { class CanvasProperties; }
+
+//
+// Thread-safe pool of render view pixel buffers.
+//
+// Buffers are handed out as shared pointers whose deleter gives the buffer
+// back to the pool once the last event referencing it is gone. Buffers are
+// sized from the frame's tile size; buffers of a previous tile size are freed
+// on release.
+// The pool must be created with boost::shared_ptr since outstanding buffers
+// keep it alive.
+//
+
+class DisplayBufferPool
+  : public boost::enable_shared_from_this<DisplayBufferPool>
+  , public foundation::NonCopyable
+{
+  public:
+    DisplayBufferPool();
+    ~DisplayBufferPool();
+
+    // Buffer large enough for any tile of the frame.
+    boost::shared_ptr<RV_PIXEL> acquireTile(const foundation::CanvasProperties& props);
+
+  private:
+    struct Slab
+    {
+        size_t                  capacity;   // in pixels
+        size_t                  maxFree;    // number of free buffers kept around
+        std::vector<RV_PIXEL*>  freeList;
+    };
+
+    struct Releaser
+    {
+        boost::shared_ptr<DisplayBufferPool>    pool;
+        size_t                                  capacity;
+
+        void operator()(RV_PIXEL* pixels) const;
+    };
+
+    boost::mutex    mMutex;
+    Slab            mTiles;
+
+    boost::shared_ptr<RV_PIXEL> acquire(Slab& slab, const size_t capacity);
+    void release(RV_PIXEL* pixels, const size_t capacity);
+
+    static void clear(Slab& slab);
+};
+
+#endif  // !DISPLAYBUFFERPOOL_H
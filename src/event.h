@@ -39,6 +39,9 @@
 // Boost headers.
 #include "boost/shared_ptr.hpp"
 
+// Standard headers.
+#include <algorithm>
+
 class Event
 {
   public:
@@ -71,6 +74,27 @@ class Event
     int yMin;
     int yMax;
     boost::shared_ptr<RV_PIXEL> pixels;
+
+    // Used by the render event queue to move events in and out of its slots.
+    void swap(Event& other)
+    {
+        std::swap(mType, other.mType);
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(useRenderRegion, other.useRenderRegion);
+        std::swap(cameraDagPath, other.cameraDagPath);
+        std::swap(renderType, other.renderType);
+        std::swap(xMin, other.xMin);
+        std::swap(xMax, other.xMax);
+        std::swap(yMin, other.yMin);
+        std::swap(yMax, other.yMax);
+        pixels.swap(other.pixels);
+    }
 };
 
+inline void swap(Event& lhs, Event& rhs)
+{
+    lhs.swap(rhs);
+}
+
 #endif  // !EVENT_H
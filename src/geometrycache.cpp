@@ -0,0 +1,300 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "geometrycache.h"
+
+// appleseed-maya headers.
+#include "utilities/hashtools.h"
+#include "utilities/logging.h"
+#include "utilities/meshtools.h"
+#include "mayaobject.h"
+
+// appleseed.renderer headers.
+#include "renderer/api/scene.h"
+
+// Maya headers.
+#include <maya/MFloatArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MIntArray.h>
+#include <maya/MString.h>
+
+// Standard headers.
+#include <vector>
+
+namespace
+{
+    // Arrays are hashed with their length so that the boundary between two
+    // consecutive arrays is part of the hash.
+    foundation::uint64 hashIntArray(foundation::uint64 hash, const MIntArray& array)
+    {
+        const unsigned int length = array.length();
+        hash = hashBytes(hash, &length, sizeof(length));
+
+        if (length > 0)
+        {
+            std::vector<int> values(length);
+            array.get(&values[0]);
+            hash = hashBytes(hash, &values[0], length * sizeof(int));
+        }
+
+        return hash;
+    }
+
+    foundation::uint64 hashFloatArray(foundation::uint64 hash, const MFloatArray& array)
+    {
+        const unsigned int length = array.length();
+        hash = hashBytes(hash, &length, sizeof(length));
+
+        if (length > 0)
+        {
+            std::vector<float> values(length);
+            array.get(&values[0]);
+            hash = hashBytes(hash, &values[0], length * sizeof(float));
+        }
+
+        return hash;
+    }
+}
+
+GeometrySignature::GeometrySignature()
+  : vertexCount(0)
+  , faceVertexCount(0)
+  , polygonCount(0)
+  , uvCount(0)
+  , materialSlotCount(0)
+  , smoothLevel(0)
+  , contentHash(0)
+  , topologyHash(0)
+  , hasTopologyHash(false)
+{
+}
+
+bool GeometrySignature::hasSameContent(const GeometrySignature& other) const
+{
+    return
+        vertexCount == other.vertexCount &&
+        faceVertexCount == other.faceVertexCount &&
+        polygonCount == other.polygonCount &&
+        uvCount == other.uvCount &&
+        materialSlotCount == other.materialSlotCount &&
+        smoothLevel == other.smoothLevel &&
+        contentHash == other.contentHash;
+}
+
+GeometrySignature computeGeometrySignature(const MayaObject* obj)
+{
+    MStatus stat;
+    MFnMesh meshFn(obj->mobject, &stat);
+    CHECK_MSTATUS(stat);
+
+    GeometrySignature signature;
+    signature.vertexCount = meshFn.numVertices();
+    signature.faceVertexCount = meshFn.numFaceVertices();
+    signature.polygonCount = meshFn.numPolygons();
+    signature.uvCount = meshFn.numUVs();
+    signature.materialSlotCount = obj->shadingGroups.length();
+    signature.smoothLevel = getRenderSmoothLevel(obj->mobject);
+
+    // The smooth mesh, if any, is determined by the cage and the smooth options.
+    // Hard and soft edges show up in the normals.
+    foundation::uint64 hash = HashSeed;
+
+    const float* points = meshFn.getRawPoints(&stat);
+    if (stat)
+        hash = hashBytes(hash, points, signature.vertexCount * 3 * sizeof(float));
+
+    const float* normals = meshFn.getRawNormals(&stat);
+    if (stat)
+        hash = hashBytes(hash, normals, meshFn.numNormals() * 3 * sizeof(float));
+
+    hash = hashIntArray(hash, obj->perFaceAssignments);
+    hash = hashRenderSmoothOptions(hash, obj->mobject);
+
+    signature.contentHash = hash;
+
+    return signature;
+}
+
+void computeTopologyHash(const MayaObject* obj, GeometrySignature& signature)
+{
+    MStatus stat;
+    MFnMesh meshFn(obj->mobject, &stat);
+    CHECK_MSTATUS(stat);
+
+    foundation::uint64 hash = HashSeed;
+
+    MFloatArray uArray, vArray;
+    meshFn.getUVs(uArray, vArray);
+    hash = hashFloatArray(hash, uArray);
+    hash = hashFloatArray(hash, vArray);
+
+    MIntArray counts, ids;
+    meshFn.getVertices(counts, ids);
+    hash = hashIntArray(hash, counts);
+    hash = hashIntArray(hash, ids);
+
+    meshFn.getNormalIds(counts, ids);
+    hash = hashIntArray(hash, ids);
+
+    counts.clear();
+    ids.clear();
+    if (meshFn.numUVs() > 0)
+        meshFn.getAssignedUVs(counts, ids);
+    hash = hashIntArray(hash, counts);
+    hash = hashIntArray(hash, ids);
+
+    signature.topologyHash = hash;
+    signature.hasTopologyHash = true;
+}
+
+GeometryCache::GeometryCache()
+  : mHits(0)
+  , mMisses(0)
+{
+}
+
+GeometryCache::~GeometryCache()
+{
+    clear();
+}
+
+foundation::auto_release_ptr<renderer::MeshObject> GeometryCache::fetch(
+    const MayaObject*           obj,
+    GeometrySignature&          signature)
+{
+    EntryMap::iterator i = mEntries.find(obj->fullName.asChar());
+
+    if (i != mEntries.end() && i->second.mesh != 0 && i->second.signature.hasSameContent(signature))
+    {
+        if (!signature.hasTopologyHash)
+            computeTopologyHash(obj, signature);
+
+        if (i->second.signature.topologyHash == signature.topologyHash)
+        {
+            renderer::MeshObject* mesh = i->second.mesh;
+            i->second.mesh = 0;
+            ++mHits;
+            return foundation::auto_release_ptr<renderer::MeshObject>(mesh);
+        }
+    }
+
+    if (i != mEntries.end())
+    {
+        release(i->second);
+        mEntries.erase(i);
+    }
+
+    ++mMisses;
+    return foundation::auto_release_ptr<renderer::MeshObject>();
+}
+
+void GeometryCache::record(
+    const MayaObject*           obj,
+    GeometrySignature&          signature,
+    const std::string&          assemblyName,
+    const std::string&          meshName)
+{
+    // The next frame can only compare the topology with a complete signature.
+    if (!signature.hasTopologyHash)
+        computeTopologyHash(obj, signature);
+
+    Entry& entry = mEntries[obj->fullName.asChar()];
+    release(entry);
+    entry.signature = signature;
+    entry.assemblyName = assemblyName;
+    entry.meshName = meshName;
+}
+
+void GeometryCache::park(renderer::Assembly& world)
+{
+    size_t dropped = 0;
+
+    for (EntryMap::iterator i = mEntries.begin(); i != mEntries.end(); )
+    {
+        Entry& entry = i->second;
+
+        // Still parked since the previous frame: the shape is gone.
+        if (entry.mesh != 0)
+        {
+            release(entry);
+            mEntries.erase(i++);
+            ++dropped;
+            continue;
+        }
+
+        renderer::Assembly* assembly =
+            entry.assemblyName == world.get_name()
+                ? &world
+                : world.assemblies().get_by_name(entry.assemblyName.c_str());
+
+        renderer::Object* object =
+            assembly != 0
+                ? assembly->objects().get_by_name(entry.meshName.c_str())
+                : 0;
+
+        if (object == 0)
+        {
+            mEntries.erase(i++);
+            ++dropped;
+            continue;
+        }
+
+        foundation::auto_release_ptr<renderer::Object> removed(assembly->objects().remove(object));
+        entry.mesh = static_cast<renderer::MeshObject*>(removed.release());
+        ++i;
+    }
+
+    Logging::info(
+        MString("Geometry cache: ") + static_cast<int>(mHits) + " hits, " +
+        static_cast<int>(mMisses) + " misses, " +
+        static_cast<int>(mEntries.size()) + " meshes kept, " +
+        static_cast<int>(dropped) + " dropped.");
+
+    mHits = 0;
+    mMisses = 0;
+}
+
+void GeometryCache::clear()
+{
+    for (EntryMap::iterator i = mEntries.begin(); i != mEntries.end(); ++i)
+        release(i->second);
+
+    mEntries.clear();
+    mHits = 0;
+    mMisses = 0;
+}
+
+void GeometryCache::release(Entry& entry)
+{
+    if (entry.mesh != 0)
+    {
+        entry.mesh->release();
+        entry.mesh = 0;
+    }
+}
@@ -0,0 +1,147 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+// appleseed.renderer headers.
+#include "renderer/api/object.h"
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/platform/types.h"
+#include "foundation/utility/autoreleaseptr.h"
+
+// Standard headers.
+#include <cstddef>
+#include <map>
+#include <string>
+
+// Forward declarations.
+namespace renderer  { class Assembly; }
+class MayaObject;
+
+//
+// Content signature of a mesh shape. Two shapes with the same signature
+// translate to the same appleseed mesh.
+//
+// The signature has a cheap part, made of counts and a hash of the raw
+// points and normals, and a topology hash of the uv's and the id arrays,
+// which have to be copied out of Maya. The topology hash is only computed
+// when the cheap parts of two signatures match.
+//
+
+struct GeometrySignature
+{
+    size_t              vertexCount;
+    size_t              faceVertexCount;
+    size_t              polygonCount;
+    size_t              uvCount;
+    size_t              materialSlotCount;
+    int                 smoothLevel;
+    foundation::uint64  contentHash;    // points, normals, smooth options and per face material assignments
+    foundation::uint64  topologyHash;   // uv's, face-vertex, normal and uv ids, if hasTopologyHash is set
+    bool                hasTopologyHash;
+
+    GeometrySignature();
+
+    // Compare everything but the topology hashes.
+    bool hasSameContent(const GeometrySignature& other) const;
+};
+
+// Compute the cheap part of the signature of a mesh shape.
+// obj->getShadingGroups() must have been called. Must be called from the main thread.
+GeometrySignature computeGeometrySignature(const MayaObject* obj);
+
+// Add the topology hash to a signature computed by computeGeometrySignature().
+// Must be called from the main thread.
+void computeTopologyHash(const MayaObject* obj, GeometrySignature& signature);
+
+//
+// Keeps the appleseed meshes of a batch sequence alive across frames.
+//
+// The world assembly is rebuilt for every frame. Before it is removed, park()
+// takes the meshes recorded during the frame out of their assemblies; during
+// the next frame, fetch() hands a mesh back if its shape's signature didn't
+// change. Meshes that were not fetched again are dropped at the next park().
+// Must only be used from the main thread.
+//
+
+class GeometryCache
+  : public foundation::NonCopyable
+{
+  public:
+    GeometryCache();
+    ~GeometryCache();
+
+    // Return the parked mesh of a shape if its signature is unchanged, or an
+    // empty pointer if the mesh must be rebuilt. The topology hash is added
+    // to signature if its cheap part matches the parked mesh.
+    foundation::auto_release_ptr<renderer::MeshObject> fetch(
+        const MayaObject*           obj,
+        GeometrySignature&          signature);
+
+    // Remember that the mesh of a shape was inserted into an assembly.
+    // The topology hash is added to signature if it is missing.
+    void record(
+        const MayaObject*           obj,
+        GeometrySignature&          signature,
+        const std::string&          assemblyName,
+        const std::string&          meshName);
+
+    // Take all recorded meshes out of the world assembly, drop the ones that
+    // were not used during this frame and log the statistics of the frame.
+    void park(renderer::Assembly& world);
+
+    // Drop all meshes.
+    void clear();
+
+  private:
+    struct Entry
+    {
+        GeometrySignature       signature;
+        std::string             assemblyName;
+        std::string             meshName;
+        renderer::MeshObject*   mesh;           // owned, only set while parked
+
+        Entry()
+          : mesh(0)
+        {
+        }
+    };
+
+    typedef std::map<std::string, Entry> EntryMap;
+
+    EntryMap    mEntries;
+    size_t      mHits;
+    size_t      mMisses;
+
+    static void release(Entry& entry);
+};
+
+#endif  // !GEOMETRYCACHE_H
@@ -37,6 +37,7 @@
 #include <maya/MFnGenericAttribute.h>
 #include <maya/MFnMessageAttribute.h>
 #include <maya/MFnNumericAttribute.h>
+#include <maya/MFnStringData.h>
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MPlug.h>
 #include <maya/MStatus.h>
@@ -136,9 +137,27 @@ MStatus GlobalsNode::initialize()
     attr.rendererVerbosity = nAttr.create("rendererVerbosity", "rendererVerbosity", MFnNumericData::kInt, 2);
     CHECK_MSTATUS(addAttribute(attr.rendererVerbosity));
 
+    attr.displayQueuePolicy = eAttr.create("displayQueuePolicy", "displayQueuePolicy", 2, &stat);
+    stat = eAttr.addField("Block", 0);
+    stat = eAttr.addField("Drop Progressive Updates", 1);
+    stat = eAttr.addField("Coalesce Progressive Updates", 2);
+    CHECK_MSTATUS(addAttribute(attr.displayQueuePolicy));
+
+    attr.progressiveEdgeInterval = nAttr.create("progressiveEdgeInterval", "progressiveEdgeInterval", MFnNumericData::kInt, 4);
+    nAttr.setMin(1);
+    nAttr.setSoftMax(8);
+    CHECK_MSTATUS(addAttribute(attr.progressiveEdgeInterval));
+
     attr.detectShapeDeform = nAttr.create("detectShapeDeform", "detectShapeDeform", MFnNumericData::kBoolean, true);
     CHECK_MSTATUS(addAttribute(attr.detectShapeDeform));
 
+    attr.deduplicateMeshes = nAttr.create("deduplicateMeshes", "deduplicateMeshes", MFnNumericData::kBoolean, false);
+    CHECK_MSTATUS(addAttribute(attr.deduplicateMeshes));
+
+    MFnStringData velocitySourcesData;
+    attr.velocitySources = tAttr.create("velocitySources", "velocitySources", MFnData::kString, velocitySourcesData.create("bifrostVelocity velocityPV velocities"));
+    CHECK_MSTATUS(addAttribute(attr.velocitySources));
+
     attr.filtersize = nAttr.create("filtersize", "filtersize", MFnNumericData::kInt, 3);
     CHECK_MSTATUS(addAttribute(attr.filtersize));
 
@@ -53,6 +53,8 @@ class GlobalsNode
         MObject threads;
         MObject translatorVerbosity;
         MObject rendererVerbosity;
+        MObject displayQueuePolicy;
+        MObject progressiveEdgeInterval;
 
         // Adaptive image sampling.
         MObject adaptiveSampling;
@@ -72,6 +74,8 @@ class GlobalsNode
         MObject motionBlurType;
 
         MObject detectShapeDeform;
+        MObject deduplicateMeshes;
+        MObject velocitySources;
 
         // Pixel filtering.
         MObject filtertype;
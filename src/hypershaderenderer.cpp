@@ -38,6 +38,7 @@
 #include "utilities/logging.h"
 #include "utilities/meshtools.h"
 #include "utilities/oslutils.h"
+#include "utilities/pixelconversion.h"
 #include "utilities/tools.h"
 #include "appleseedutils.h"
 #include "world.h"
@@ -266,6 +267,8 @@ static void startRenderThread(HypershadeRenderer* renderPtr)
 
 MStatus HypershadeRenderer::startAsync(const JobParams& params)
 {
+    // Shader plugins may have been reloaded since the last render.
+    clearAttributeCache();
     asyncStarted = true;
     return MStatus::kSuccess;
 }
@@ -835,22 +838,9 @@ bool HypershadeRenderer::isSafeToUnload()
 
 void HypershadeRenderer::copyTileToBuffer(foundation::Tile& tile, int tile_x, int tile_y)
 {
-    size_t tw = tile.get_width();
-    size_t th = tile.get_height();
-
-    for (int y = 0; y < th; y++)
-    {
-        for (int x = 0; x < tw; x++)
-        {
-            int index = ((height - 1) - (tile_y * tileSize + y)) * width + (tile_x * tileSize) + x;
-            index *= kNumChannels;
-
-            rb[index] = tile.get_component<float>(x, y, 0);
-            rb[index + 1] = tile.get_component<float>(x, y, 1);
-            rb[index + 2] = tile.get_component<float>(x, y, 2);
-            rb[index + 3] = tile.get_component<float>(x, y, 3);
-        }
-    }
+    const size_t th = tile.get_height();
+    const size_t index = (height - tile_y * tileSize - th) * width + tile_x * tileSize;
+    convertTileToDisplay(tile, rb + index * kNumChannels, width * kNumChannels, false);
 
     // The image is in R32G32B32A32_Float format.
     refreshParams.bottom = 0;
@@ -909,21 +899,9 @@ void HypershadeTileCallback::post_render(const renderer::Frame* frame)
         for (size_t tile_x = 0; tile_x < frame_props.m_tile_count_x; tile_x++)
         {
             const foundation::Tile& tile = frame->image().tile(tile_x, tile_y);
-            const size_t tw = tile.get_width();
             const size_t th = tile.get_height();
-
-            for (size_t y = 0; y < th; y++)
-            {
-                for (size_t x = 0; x < tw; x++)
-                {
-                    const size_t index = (((height - 1) - (tile_y * tileSize + y)) * width + (tile_x * tileSize) + x) * kNumChannels;
-
-                    buffer[index + 0] = tile.get_component<float>(x, y, 0);
-                    buffer[index + 1] = tile.get_component<float>(x, y, 1);
-                    buffer[index + 2] = tile.get_component<float>(x, y, 2);
-                    buffer[index + 3] = tile.get_component<float>(x, y, 3);
-                }
-            }
+            const size_t index = (height - tile_y * tileSize - th) * width + tile_x * tileSize;
+            convertTileToDisplay(tile, buffer + index * kNumChannels, width * kNumChannels, false);
         }
     }
 
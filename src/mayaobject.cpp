@@ -29,9 +29,6 @@
 #include <maya/MFnDagNode.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MPlugArray.h>
-#include <maya/MFnMesh.h>
-#include <maya/MItMeshPolygon.h>
-#include <maya/MFnMeshData.h>
 
 #include "mayaobject.h"
 #include "utilities/logging.h"
@@ -113,13 +110,60 @@ bool MayaObject::isVisiblityAnimated()
 
 bool MayaObject::isObjVisible()
 {
-    MFnDagNode dagNode(mobject);
+    const VisibilityState& state = getVisibilityState();
     return
-        IsVisible(dagNode) &&
-        !IsTemplated(dagNode) &&
-        IsInRenderLayer(dagPath) &&
-        IsPathVisible(dagPath) &&
-        IsLayerVisible(dagPath);
+        state.pathVisible &&
+        !state.templated &&
+        state.inRenderLayer &&
+        state.layerVisible;
+}
+
+uint MayaObject::visibilityEpoch = 1;
+
+void MayaObject::invalidateVisibility()
+{
+    visibilityEpoch++;
+}
+
+const MayaObject::VisibilityState& MayaObject::getVisibilityState()
+{
+    VisibilityState& state = visibilityState;
+    if (state.epoch == visibilityEpoch)
+        return state;
+
+    state.epoch = visibilityEpoch;
+
+    if (mobject.hasFn(MFn::kWorld))
+    {
+        state.pathVisible = true;
+        state.layerVisible = true;
+        state.inRenderLayer = true;
+        state.templated = false;
+        return state;
+    }
+
+    MFnDagNode dagNode(mobject);
+    state.templated = IsTemplated(dagNode);
+
+    if (parent)
+    {
+        const VisibilityState& parentState = parent->getVisibilityState();
+        state.pathVisible = parentState.pathVisible && IsVisible(dagNode);
+        state.layerVisible = parentState.layerVisible && IsNodeLayerVisible(mobject);
+        // the world is not a render layer member, so its children have to ask for themselves
+        state.inRenderLayer =
+            (parentState.inRenderLayer && !parent->mobject.hasFn(MFn::kWorld)) ||
+            IsInRenderLayer(dagPath);
+    }
+    else
+    {
+        // objects created without their parent objects, e.g. by node callbacks, have to check the whole path
+        state.pathVisible = IsPathVisible(dagPath);
+        state.layerVisible = IsLayerVisible(dagPath);
+        state.inRenderLayer = IsInRenderLayer(dagPath);
+    }
+
+    return state;
 }
 
 bool MayaObject::geometryShapeSupported()
@@ -147,8 +191,25 @@ bool MayaObject::shadowMapCastingLight()
     return true;
 }
 
+// Flags that only depend on plain attributes of the node. Scripts can change
+// them between two frames without any DAG or connection change, so they are
+// read again whenever the object is updated.
+void MayaObject::updateAttributeFlags()
+{
+    MFnDependencyNode depFn(mobject);
+    motionBlurred = true;
+    bool mb = true;
+    if (getBool(MString("motionBlur"), depFn, mb))
+        motionBlurred = mb;
+    // cameras have motionBlur attribute but it is set to false by default and it is not accessible via UI
+    // but we want to have a blurred camera by default.
+    if (mobject.hasFn(MFn::kCamera))
+        motionBlurred = true;
+}
+
 void MayaObject::updateObject()
 {
+    updateAttributeFlags();
     visible = isObjVisible();
 }
 
@@ -166,28 +227,19 @@ void MayaObject::initialize()
     transformMatrices.push_back(dagPath.inclusiveMatrix());
     instanceNumber = dagPath.instanceNumber();
     MFnDependencyNode depFn(mobject);
-    motionBlurred = true;
     geometryMotionblur = false;
-    bool mb = true;
-    if (getBool(MString("motionBlur"), depFn, mb))
-        motionBlurred = mb;
-    // cameras have motionBlur attribute but it is set to false by default and it is not accessible via UI
-    // but we want to have a blurred camera by default.
-    if (mobject.hasFn(MFn::kCamera))
-        motionBlurred = true;
+    updateAttributeFlags();
     perObjectTransformSteps = 1;
     perObjectDeformSteps = 1;
     shapeConnected = false;
     animated = isObjAnimated();
+    transformAnimated = animated;
     shapeConnected = isShapeConnected();
     parent.reset();
+    // the visibility depends on the parent objects, it is updated as soon as the parent is known
     visible = true;
+    visibilityState.epoch = 0;
     hasInstancerConnection = false;
-    MDagPath dp;
-    dp = dagPath;
-    MFnDagNode dagNode(mobject);
-    if (!IsVisible(dagNode) || IsTemplated(dagNode) || !IsInRenderLayer(dp) || !IsPathVisible(dp) || !IsLayerVisible(dagPath))
-        visible = false;
 
     // get instancer connection
     MStatus stat;
@@ -305,271 +357,6 @@ bool MayaObject::isShapeConnected()
     return returnValue;
 }
 
-// if we have a mesh and it is a bifrost mesh it may contain velocity vertex data
-bool MayaObject::hasBifrostVelocityChannel()
-{
-    MFnMesh meshFn(mobject);
-    int numColorSets = meshFn.numColorSets();
-    MStringArray colorSetNames;
-    meshFn.getColorSetNames(colorSetNames);
-    for (uint i = 0; i < colorSetNames.length(); i++)
-    {
-        if (colorSetNames[i] == "bifrostVelocity")
-            return true;
-    }
-    return false;
-}
-
-// get the mesh informations from the current time and save it in the meshDataList
-void MayaObject::addMeshData()
-{
-    MeshData mdata;
-
-    if (hasBifrostVelocityChannel())
-    {
-        bool doMb = motionBlurred;
-        boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
-        doMb = doMb && renderGlobals->doMb;
-
-        Logging::debug(MString("Found bifrost velocity data for object: ") + shortName);
-        if ((meshDataList.size() == 2) || !doMb)
-        {
-            Logging::debug("Bifrost mesh already has two motion steps or mb is turned off for it -> skipping");
-            return;
-        }
-
-        getMeshData(mdata.points, mdata.normals);
-
-        // if we have a bifrost velocity channel I suppose this is a bifost mesh and there is no need to
-        // save the mesh motion steps because it has changing topology what does not work in most renderers
-        // so we save only the very first motion step and derive the other steps from velocity channel.
-        // and we simply produce two steps only because everything else would not make sense.
-
-        MFnMesh meshFn(mobject);
-        if (meshFn.hasColorChannels("bifrostVelocity"))
-        {
-            MColorArray colors;
-            MString colorSetName = "bifrostVelocity";
-            meshFn.getVertexColors(colors, &colorSetName);
-
-            if (colors.length() == mdata.points.length())
-            {
-                for (uint ptId = 0; ptId < mdata.points.length(); ptId++)
-                {
-                    MColor c = colors[ptId];
-                    MVector v = MVector(c.r, c.g, c.b);
-                    mdata.points[ptId] -= v * 0.5 / 24.0;
-                }
-                meshDataList.push_back(mdata);
-                for (uint ptId = 0; ptId < mdata.points.length(); ptId++)
-                {
-                    MColor c = colors[ptId];
-                    MVector v = MVector(c.r, c.g, c.b);
-                    mdata.points[ptId] += v * 0.5 / 24.0;
-                }
-                meshDataList.push_back(mdata);
-            }
-        }
-        else
-        {
-            Logging::debug("Bifrost mesh has no velocity data, no motionblur.");
-            if (meshDataList.size() == 0)
-                meshDataList.push_back(mdata);
-        }
-    }
-    else
-    {
-        getMeshData(mdata.points, mdata.normals);
-        int np = mdata.points.length();
-        meshDataList.push_back(mdata);
-
-        std::vector<MeshData>::iterator mdIt;
-        for (mdIt = meshDataList.begin(); mdIt != meshDataList.end(); mdIt++)
-        {
-            np = mdIt->points.length();
-        }
-    }
-}
-
-void MayaObject::getMeshData(MPointArray& points, MFloatVectorArray& normals)
-{
-    MStatus stat;
-    MObject meshObject = mobject;
-    MMeshSmoothOptions options;
-    MFnMesh tmpMesh(mobject);
-    MFnMeshData meshData;
-    MObject dataObject;
-    MObject smoothedObj;
-
-    // create smooth mesh if needed
-    if (tmpMesh.findPlug("displaySmoothMesh").asBool())
-    {
-        stat = tmpMesh.getSmoothMeshDisplayOptions(options);
-        if (stat)
-        {
-            if (!tmpMesh.findPlug("useSmoothPreviewForRender", false, &stat).asBool())
-            {
-                int smoothLevel = tmpMesh.findPlug("renderSmoothLevel", false, &stat).asInt();
-                options.setDivisions(smoothLevel);
-            }
-            if (options.divisions() > 0)
-            {
-                dataObject = meshData.create();
-                smoothedObj = tmpMesh.generateSmoothMesh(dataObject, &options, &stat);
-                if (stat)
-                {
-                    meshObject = smoothedObj;
-                }
-            }
-        }
-    }
-    MFnMesh meshFn(meshObject, &stat);
-    if (!stat)
-    {
-        MString error = stat.errorString();
-        Logging::error(error);
-    }
-    meshFn.getPoints(points);
-    meshFn.getNormals(normals, MSpace::kObject);
-}
-
-void MayaObject::getMeshData(MPointArray& points, MFloatVectorArray& normals, MFloatArray& uArray, MFloatArray& vArray, MIntArray& triPointIndices, MIntArray& triNormalIndices, MIntArray& triUvIndices, MIntArray& triMatIndices)
-{
-    MStatus stat;
-    MObject meshObject = mobject;
-    MMeshSmoothOptions options;
-    MFnMesh tmpMesh(mobject, &stat);
-
-    MFnMeshData meshData;
-    MObject dataObject;
-    MObject smoothedObj;
-
-    // create smooth mesh if needed
-    if (tmpMesh.findPlug("displaySmoothMesh").asBool())
-    {
-        stat = tmpMesh.getSmoothMeshDisplayOptions(options);
-        if (stat)
-        {
-            if (!tmpMesh.findPlug("useSmoothPreviewForRender", false, &stat).asBool())
-            {
-                int smoothLevel = tmpMesh.findPlug("renderSmoothLevel", false, &stat).asInt();
-                options.setDivisions(smoothLevel);
-            }
-            if (options.divisions() > 0)
-            {
-                dataObject = meshData.create();
-                smoothedObj = tmpMesh.generateSmoothMesh(dataObject, &options, &stat);
-                if (stat)
-                {
-                    meshObject = smoothedObj;
-                }
-            }
-        }
-    }
-
-    MFnMesh meshFn(meshObject, &stat);
-    CHECK_MSTATUS(stat);
-    MItMeshPolygon faceIt(meshObject, &stat);
-    CHECK_MSTATUS(stat);
-
-    meshFn.getPoints(points);
-    meshFn.getNormals(normals, MSpace::kObject);
-    meshFn.getUVs(uArray, vArray);
-
-    uint numVertices = points.length();
-    uint numNormals = normals.length();
-    uint numUvs = uArray.length();
-
-    // some meshes may have no uv's
-    // to avoid problems I add a default uv coordinate
-    if (numUvs == 0)
-    {
-        Logging::warning(MString("Object has no uv's: ") + shortName);
-        uArray.append(0.0);
-        vArray.append(0.0);
-    }
-    for (uint nid = 0; nid < numNormals; nid++)
-    {
-        if (normals[nid].length() < 0.1f)
-            Logging::warning(MString("Malformed normal in ") + shortName);
-    }
-    MPointArray triPoints;
-    MIntArray triVtxIds;
-    MIntArray faceVtxIds;
-    MIntArray faceNormalIds;
-
-    for (faceIt.reset(); !faceIt.isDone(); faceIt.next())
-    {
-        int faceId = faceIt.index();
-        int numTris;
-        faceIt.numTriangles(numTris);
-        faceIt.getVertices(faceVtxIds);
-
-        int perFaceShadingGroup = 0;
-        if (perFaceAssignments.length() > 0)
-            perFaceShadingGroup = perFaceAssignments[faceId];
-
-        MIntArray faceUVIndices;
-
-        faceNormalIds.clear();
-        for (uint vtxId = 0; vtxId < faceVtxIds.length(); vtxId++)
-        {
-            faceNormalIds.append(faceIt.normalIndex(vtxId));
-            int uvIndex;
-            if (numUvs == 0)
-            {
-                faceUVIndices.append(0);
-            }
-            else
-            {
-                faceIt.getUVIndex(vtxId, uvIndex);
-                faceUVIndices.append(uvIndex);
-            }
-        }
-
-        for (int triId = 0; triId < numTris; triId++)
-        {
-            int faceRelIds[3];
-            faceIt.getTriangle(triId, triPoints, triVtxIds);
-
-            for (uint triVtxId = 0; triVtxId < 3; triVtxId++)
-            {
-                for (uint faceVtxId = 0; faceVtxId < faceVtxIds.length(); faceVtxId++)
-                {
-                    if (faceVtxIds[faceVtxId] == triVtxIds[triVtxId])
-                    {
-                        faceRelIds[triVtxId] = faceVtxId;
-                    }
-                }
-            }
-
-            uint vtxId0 = faceVtxIds[faceRelIds[0]];
-            uint vtxId1 = faceVtxIds[faceRelIds[1]];
-            uint vtxId2 = faceVtxIds[faceRelIds[2]];
-            uint normalId0 = faceNormalIds[faceRelIds[0]];
-            uint normalId1 = faceNormalIds[faceRelIds[1]];
-            uint normalId2 = faceNormalIds[faceRelIds[2]];
-            uint uvId0 = faceUVIndices[faceRelIds[0]];
-            uint uvId1 = faceUVIndices[faceRelIds[1]];
-            uint uvId2 = faceUVIndices[faceRelIds[2]];
-
-            triPointIndices.append(vtxId0);
-            triPointIndices.append(vtxId1);
-            triPointIndices.append(vtxId2);
-
-            triNormalIndices.append(normalId0);
-            triNormalIndices.append(normalId1);
-            triNormalIndices.append(normalId2);
-
-            triUvIndices.append(uvId0);
-            triUvIndices.append(uvId1);
-            triUvIndices.append(uvId2);
-
-            triMatIndices.append(perFaceShadingGroup);
-        }
-    }
-}
-
 //  The purpose of this method is to compare object attributes and inherit them if appropriate.
 //  e.g. lets say we assign a color to the top node of a hierarchy. Then all child nodes will be
 //  called and this method is used.
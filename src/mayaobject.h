@@ -54,16 +54,6 @@
 class Material;
 class MayaObject;
 
-// not all renderers can define a mesh and then upate it later in the
-// translation process. e.g. Corona needs all motion mesh informations during
-// mesh definition and cannot modify it with additional motion steps.
-// So we use this struct to collect the necessary deform informations.
-struct MeshData
-{
-    MPointArray points;
-    MFloatVectorArray normals;
-};
-
 // the idea of objectAttributes is to share informations down the whole hierarchy.
 // an attribute will be created with its parent as argument so it can copy the interesting data
 class ObjectAttributes
@@ -94,14 +84,13 @@ class MayaObject
     bool removed; // in IPR we simply flag an object as removed instead of really removing it
     boost::shared_ptr<ObjectAttributes> attributes;
 
-    std::vector<boost::shared_ptr<MayaObject> >  excludedObjects; // for lights - excluded objects
+    std::vector<size_t> excludedObjects; // for lights - indices of the excluded objects in MayaScene::objectList
 
     std::vector<MString> exportFileNames; // for every mb step complete filename for every exported shape file
     std::vector<MString> hierarchyNames; // for every geo mb step I have one name, /obj/cube0, /obj/cube1...
     std::vector<MMatrix> transformMatrices; // for every xmb step I have one matrix
     std::vector<MString> shadowMapFiles; // file paths for a shadow map creating light
 
-    std::vector<MeshData> meshDataList;
     MObjectArray shadingGroups;
     MIntArray perFaceAssignments;
     std::vector<boost::shared_ptr<Material> > materialList; // for every shading group connected to the shape, we have a material
@@ -114,6 +103,7 @@ class MayaObject
     MDagPath instancerDagPath;
 
     bool animated;
+    bool transformAnimated;      // the object or one of its parents is animated, so its world matrix can change over time
     bool hasInstancerConnection; // if yes, then the objects below can be visible via instancer even if the original object is not
     bool shapeConnected;         // if shape connected, it can be used to determine if it has to be exported for every frame or not
     bool visible;                // important for instances: orig object can be invisible but must be exported
@@ -130,12 +120,6 @@ class MayaObject
     bool isVisiblityAnimated();
     bool isInstanced();
     void getShadingGroups();
-    bool hasBifrostVelocityChannel();
-    void addMeshData(); // add point/normals to the meshDataList for motionsteps
-    void getMeshData(MPointArray& point, MFloatVectorArray& normals);
-    void getMeshData(MPointArray& point, MFloatVectorArray& normals, MFloatArray& u,
-                    MFloatArray& v, MIntArray& triPointIndices, MIntArray& triNormalIndices,
-                    MIntArray& triUvIndices, MIntArray& triMatIndices); // all triIndices contain per vertex indices except the triMatIndices, this is per face
 
     bool geometryShapeSupported();
 
@@ -149,10 +133,35 @@ class MayaObject
     MayaObject(MDagPath& objPath);
 
     void initialize();
+
+    // Re-read the state that can change between two evaluations: the
+    // attribute driven flags and the visibility.
     void updateObject();
 
+    // Visibility of the object including the inherited state of its parents.
+    // It is evaluated top-down through the parent objects and kept until the
+    // next call to invalidateVisibility(), so every node is only queried once
+    // per evaluation instead of once for every object below it.
+    struct VisibilityState
+    {
+        bool pathVisible;    // the node and all its parents are visible and not intermediate
+        bool layerVisible;   // the display layers of the node and its parents are visible and not templated
+        bool inRenderLayer;  // the node or one of its parents is a member of the current render layer
+        bool templated;      // the node itself is templated
+        uint epoch;
+    };
+
+    const VisibilityState& getVisibilityState();
+
+    // Has to be called whenever the visibility can have changed, e.g. for a new frame or an IPR update.
+    static void invalidateVisibility();
+
   private:
     bool needsAssembly();
+    void updateAttributeFlags();
+
+    VisibilityState visibilityState;
+    static uint visibilityEpoch;
 };
 
 #endif  // !MAYAOBJECT_H
@@ -32,8 +32,8 @@
 // appleseed-maya headers.
 #include "shadingtools/shadingutils.h"
 #include "utilities/attrtools.h"
+#include "utilities/hashtools.h"
 #include "utilities/logging.h"
-#include "utilities/pystring.h"
 #include "utilities/tools.h"
 #include "nodecallbacks.h"
 #include "renderglobals.h"
@@ -46,15 +46,20 @@
 #include <maya/MFnDagNode.h>
 #include <maya/MFnMesh.h>
 #include <maya/MDagPathArray.h>
+#include <maya/MDGMessage.h>
 #include <maya/MFnCamera.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnInstancer.h>
 #include <maya/MFnParticleSystem.h>
+#include <maya/MFnSet.h>
+#include <maya/MItDependencyNodes.h>
 #include <maya/MMatrixArray.h>
 #include <maya/MIntArray.h>
 #include <maya/MLightLinks.h>
 #include <maya/MNodeMessage.h>
+#include <maya/MPlugArray.h>
 #include <maya/MSelectionList.h>
+#include <maya/MTime.h>
 #include <maya/MGlobal.h>
 #include <maya/MRenderView.h>
 #include <maya/MVectorArray.h>
@@ -62,19 +67,109 @@
 #include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnComponent.h>
 
+// Boost headers.
+#include "boost/unordered_map.hpp"
+#include "boost/unordered_set.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
 MayaScene::MayaScene()
   : isAnyDirty(false)
+  , changeLogOverflow(false)
+  , lightLinksChanged(false)
+  , sceneParsed(false)
+{
+}
+
+MayaScene::~MayaScene()
 {
+    stopChangeTracking();
 }
 
-bool MayaScene::lightObjectIsInLinkedLightList(boost::shared_ptr<MayaObject> lightObject, MDagPathArray& linkedLightsArray)
+namespace
 {
-    for (uint lId = 0; lId < linkedLightsArray.length(); lId++)
+    // Instanced lights share their node, so a node may map to several lights.
+    typedef boost::unordered_multimap<MObjectHandle, size_t, MObjectHandleHash> LightIndexMap;
+
+    // Past this number of changed nodes, the scene is parsed again from scratch.
+    const size_t ChangeLogCapacity = 1024;
+
+    bool isConnectedTo(const MPlug& plug, const MObject& node)
     {
-        if (lightObject->mobject == linkedLightsArray[lId].node())
-            return true;
+        MPlugArray sources;
+        plug.connectedTo(sources, true, false);
+        return sources.length() > 0 && sources[0].node() == node;
+    }
+
+    bool isConnected(const MPlug& plug)
+    {
+        MPlugArray sources;
+        plug.connectedTo(sources, true, false);
+        return sources.length() > 0;
+    }
+
+    // Return true if every light illuminates every object: all lights are members
+    // of the default light set, and the light linkers only link shading groups
+    // to the default light set and have no ignore entries.
+    bool hasDefaultLightLinking(const std::vector<boost::shared_ptr<MayaObject> >& lights)
+    {
+        MStatus stat;
+        MSelectionList list;
+        MObject defaultLightSet;
+        if (!list.add("defaultLightSet") || !list.getDependNode(0, defaultLightSet))
+            return false;
+
+        MFnSet setFn(defaultLightSet, &stat);
+        if (!stat)
+            return false;
+
+        // The light transforms are the members of the set.
+        for (size_t lObjId = 0; lObjId < lights.size(); lObjId++)
+        {
+            MDagPath transformPath = lights[lObjId]->dagPath;
+            if (lights[lObjId]->mobject.hasFn(MFn::kShape))
+                transformPath.pop();
+            if (!setFn.isMember(transformPath) && !setFn.isMember(lights[lObjId]->dagPath))
+                return false;
+        }
+
+        for (MItDependencyNodes it(MFn::kLightLink); !it.isDone(); it.next())
+        {
+            MFnDependencyNode linkerFn(it.thisNode());
+
+            MObject lightAttr = linkerFn.attribute("light");
+            MPlug linkPlug = linkerFn.findPlug("link", false, &stat);
+            if (!stat || lightAttr.isNull())
+                return false;
+
+            for (uint i = 0; i < linkPlug.numElements(); i++)
+            {
+                const MPlug lightPlug = linkPlug.elementByPhysicalIndex(i).child(lightAttr);
+                if (isConnected(lightPlug) && !isConnectedTo(lightPlug, defaultLightSet))
+                    return false;
+            }
+
+            MObject lightIgnoredAttr = linkerFn.attribute("lightIgnored");
+            MObject objectIgnoredAttr = linkerFn.attribute("objectIgnored");
+            MPlug ignorePlug = linkerFn.findPlug("ignore", false, &stat);
+            if (!stat || lightIgnoredAttr.isNull() || objectIgnoredAttr.isNull())
+                return false;
+
+            for (uint i = 0; i < ignorePlug.numElements(); i++)
+            {
+                const MPlug element = ignorePlug.elementByPhysicalIndex(i);
+                if (isConnected(element.child(lightIgnoredAttr)) || isConnected(element.child(objectIgnoredAttr)))
+                    return false;
+            }
+        }
+
+        return true;
     }
-    return false;
 }
 
 // we have to take care for the component assignments in light linking.
@@ -83,14 +178,34 @@ bool MayaScene::lightObjectIsInLinkedLightList(boost::shared_ptr<MayaObject> lig
 
 void MayaScene::getLightLinking()
 {
+    for (size_t lObjId = 0; lObjId < lightList.size(); lObjId++)
+        lightList[lObjId]->excludedObjects.clear();
+
+    if (lightList.empty())
+        return;
+
+    // Querying the links of every object is expensive, skip it if no object can be excluded.
+    if (hasDefaultLightLinking(lightList))
+    {
+        Logging::debug("Default light linking, no light exclusions.");
+        return;
+    }
+
     MLightLinks lightLink;
     bool parseStatus;
     parseStatus = lightLink.parseLinks(MObject::kNullObj);
 
-    std::vector<boost::shared_ptr<MayaObject> >::iterator oIt;
-    for (oIt = objectList.begin(); oIt != objectList.end(); oIt++)
+    // Index of every light node, so that linked lights are resolved with one hash lookup each.
+    LightIndexMap lightIndices;
+    for (size_t lObjId = 0; lObjId < lightList.size(); lObjId++)
+        lightIndices.insert(std::make_pair(MObjectHandle(lightList[lObjId]->mobject), lObjId));
+
+    // linkStamps[l] == objId + 1 if light l is linked to object objId.
+    std::vector<size_t> linkStamps(lightList.size(), 0);
+
+    for (size_t objId = 0; objId < objectList.size(); objId++)
     {
-        boost::shared_ptr<MayaObject> obj = *oIt;
+        const boost::shared_ptr<MayaObject>& obj = objectList[objId];
         MDagPathArray lightArray;
 
         if (!obj->mobject.hasFn(MFn::kMesh) && !obj->mobject.hasFn(MFn::kNurbsSurface) && !obj->mobject.hasFn(MFn::kNurbsCurve))
@@ -128,20 +243,48 @@ void MayaScene::getLightLinking()
         {
             lightLink.getLinkedLights(obj->dagPath, MObject::kNullObj, lightArray);
         }
-        // if one of the light in my scene light list is NOT in the linked light list,
-        // the light has either turned off "Illuminate by default" or it is explicitly not linked to this object.
-        for (size_t lObjId = 0; lObjId < this->lightList.size(); lObjId++)
+
+        size_t linkedCount = 0;
+        for (uint lp = 0; lp < lightArray.length(); lp++)
         {
-            if (!lightObjectIsInLinkedLightList(this->lightList[lObjId], lightArray))
+            const std::pair<LightIndexMap::const_iterator, LightIndexMap::const_iterator> range =
+                lightIndices.equal_range(MObjectHandle(lightArray[lp].node()));
+
+            for (LightIndexMap::const_iterator l = range.first; l != range.second; ++l)
             {
-                this->lightList[lObjId]->excludedObjects.push_back(obj);
+                if (linkStamps[l->second] != objId + 1)
+                {
+                    linkStamps[l->second] = objId + 1;
+                    ++linkedCount;
+                }
             }
         }
+
+        // Default linking: every light illuminates the object.
+        if (linkedCount == lightList.size())
+            continue;
+
+        // if one of the light in my scene light list is NOT in the linked light list,
+        // the light has either turned off "Illuminate by default" or it is explicitly not linked to this object.
+        for (size_t lObjId = 0; lObjId < lightList.size(); lObjId++)
+        {
+            if (linkStamps[lObjId] != objId + 1)
+                lightList[lObjId]->excludedObjects.push_back(objId);
+        }
     }
 }
 
 namespace
 {
+    // Hypershade material previews live below "shaderBall" nodes. A node's
+    // full path contains "shaderBall" if and only if one of its ancestors or
+    // the node itself has it in its name, and the subtree of such a node is
+    // never traversed, so checking the node's own name is enough.
+    bool isShaderBall(const MDagPath& path)
+    {
+        return strstr(MFnDependencyNode(path.node()).name().asChar(), "shaderBall") != 0;
+    }
+
     MDagPath getWorld()
     {
         MItDag dagIterator(MItDag::kDepthFirst, MFn::kInvalid);
@@ -160,21 +303,25 @@ namespace
 bool MayaScene::parseSceneHierarchy(MDagPath currentPath, int level, boost::shared_ptr<ObjectAttributes> parentAttributes, boost::shared_ptr<MayaObject> parentObject)
 {
     // filter the new hypershade objects away
-    if (pystring::find(currentPath.fullPathName().asChar(), "shaderBall") > -1)
+    if (isShaderBall(currentPath))
         return true;
 
     boost::shared_ptr<MayaObject> mayaObject(new MayaObject(currentPath));
     boost::shared_ptr<ObjectAttributes> currentAttributes = mayaObject->getObjectAttributes(parentAttributes);
     mayaObject->parent = parentObject;
+    mayaObject->transformAnimated = mayaObject->animated || (parentObject && parentObject->transformAnimated);
+    mayaObject->updateObject();
 
     if (mayaObject->mobject.hasFn(MFn::kCamera))
         camList.push_back(mayaObject);
     else if (mayaObject->mobject.hasFn(MFn::kLight))
         lightList.push_back(mayaObject);
     else if (mayaObject->mobject.hasFn(MFn::kInstancer))
-        instancerDagPathList.push_back(mayaObject->dagPath);
+        instancerList.push_back(mayaObject);
     else objectList.push_back(mayaObject);
 
+    nodeObjects.insert(std::make_pair(MObjectHandle(mayaObject->mobject), mayaObject));
+
     if (getWorldPtr()->getRenderType() == World::IPRRENDER)
     {
         MCallbackId callbackId = MNodeMessage::addNodeDirtyCallback(mayaObject->mobject, IPRNodeDirtyCallback);
@@ -200,19 +347,12 @@ bool MayaScene::parseSceneHierarchy(MDagPath currentPath, int level, boost::shar
     //
 
     if (currentPath.instanceNumber() == 0)
-        origObjects.push_back(mayaObject);
+        origObjects.insert(std::make_pair(MObjectHandle(mayaObject->mobject), mayaObject));
     else
     {
-        MFnDagNode node(currentPath.node());
-        for (size_t iId = 0; iId < origObjects.size(); iId++)
-        {
-            MFnDagNode onode(origObjects[iId]->mobject);
-            if (onode.object() == node.object())
-            {
-                mayaObject->origObject = origObjects[iId];
-                break;
-            }
-        }
+        const MayaObjectMap::const_iterator orig = origObjects.find(MObjectHandle(mayaObject->mobject));
+        if (orig != origObjects.end())
+            mayaObject->origObject = orig->second;
     }
 
     uint numChilds = currentPath.childCount();
@@ -233,16 +373,35 @@ bool MayaScene::parseSceneHierarchy(MDagPath currentPath, int level, boost::shar
 
 bool MayaScene::parseScene()
 {
+    // the visibility of already parsed parents can be outdated if the scene changed
+    MayaObject::invalidateVisibility();
+
+    if (sceneParsed && !changeLogOverflow)
+    {
+        if (parseChanges())
+            return true;
+
+        Logging::debug("Incremental scene update failed, parsing the whole scene.");
+    }
+
     origObjects.clear();
+    nodeObjects.clear();
     objectList.clear();
     camList.clear();
     lightList.clear();
+    instancerList.clear();
+
+    changedNodes.clear();
+    changeLogOverflow = false;
+    lightLinksChanged = false;
+    sceneParsed = false;
 
     MDagPath world = getWorld();
     if (parseSceneHierarchy(world, 0, boost::shared_ptr<ObjectAttributes>(), boost::shared_ptr<MayaObject>()))
     {
         this->parseInstancerNew();
         this->getLightLinking();
+        sceneParsed = changeCallbacks.length() > 0;
         if (this->uiCamera.isValid() && (MGlobal::mayaState() != MGlobal::kBatch))
         {
             boost::shared_ptr<MayaObject> cam;
@@ -267,262 +426,427 @@ bool MayaScene::parseScene()
     return false;
 }
 
-bool MayaScene::updateScene(MFn::Type updateElement)
+namespace
 {
-    for (int objId = 0; objId < objectList.size(); objId++)
-    {
-        boost::shared_ptr<MayaObject> obj = objectList[objId];
+    typedef boost::unordered_set<const MayaObject*> MayaObjectSet;
+    typedef boost::unordered_set<MObjectHandle, MObjectHandleHash> MObjectHandleSet;
 
-        if (!obj->mobject.hasFn(updateElement))
-            continue;
-
-        obj->updateObject();
+    bool isRemoved(const boost::shared_ptr<MayaObject>& obj, const MayaObjectSet& removedObjects)
+    {
+        return
+            removedObjects.count(obj.get()) > 0 ||
+            (obj->parent && removedObjects.count(obj->parent.get()) > 0) ||
+            !MObjectHandle(obj->mobject).isAlive();
+    }
 
-        // this part is only used if motionblur is turned on, else we have no MbElement::None
-        if (!obj->motionBlurred)
+    // Remove the objects of the changed nodes, of deleted nodes, and all their descendants.
+    // Objects are listed in traversal order, so parents are always checked before their children.
+    void removeObjects(std::vector<boost::shared_ptr<MayaObject> >& objects, MayaObjectSet& removedObjects)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < objects.size(); ++i)
         {
-            if (getWorldPtr()->mRenderGlobals->currentMbElement.elementType == MbElement::MotionBlurNone)
-            {
-                Logging::debug(MString("found non mb element type. Updating non mb objects.") + objId + ": " + obj->dagPath.fullPathName());
-                if (updateElement == MFn::kShape)
-                    getWorldPtr()->mRenderer->updateShape(obj);
-                if (updateElement == MFn::kTransform)
-                {
-                    obj->transformMatrices.clear();
-                    getWorldPtr()->mRenderer->updateTransform(obj);
-                    obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
-                }
-            }
+            if (isRemoved(objects[i], removedObjects))
+                removedObjects.insert(objects[i].get());
+            else
+                objects[kept++] = objects[i];
         }
+        objects.resize(kept);
+    }
 
-        if (getWorldPtr()->mRenderGlobals->isDeformStep())
+    template <typename Map>
+    void removeObjects(Map& objects, const MayaObjectSet& removedObjects)
+    {
+        for (typename Map::iterator i = objects.begin(); i != objects.end(); )
         {
-            if (obj->mobject.hasFn(MFn::kShape))
-                getWorldPtr()->mRenderer->updateShape(obj);
+            if (removedObjects.count(i->second.get()) > 0)
+                i = objects.erase(i);
+            else
+                ++i;
         }
+    }
+}
 
-        if (getWorldPtr()->mRenderGlobals->isTransformStep())
-        {
-            if (getWorldPtr()->mRenderGlobals->isMbStartStep())
-                obj->transformMatrices.clear();
+void MayaScene::startChangeTracking()
+{
+    if (changeCallbacks.length() > 0)
+        return;
 
-            obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
-            if (obj->mobject.hasFn(MFn::kTransform))
-                getWorldPtr()->mRenderer->updateTransform(obj);
-        }
+    changeCallbacks.append(MDagMessage::addAllDagChangesCallback(dagChangedCallback, this));
+    changeCallbacks.append(MDGMessage::addNodeRemovedCallback(nodeRemovedCallback, "dagNode", this));
+    changeCallbacks.append(MDGMessage::addConnectionCallback(connectionCallback, this));
+
+    // A null node watches the names of all nodes.
+    MObject allNodes;
+    changeCallbacks.append(MNodeMessage::addNameChangedCallback(allNodes, nameChangedCallback, this));
+}
+
+void MayaScene::stopChangeTracking()
+{
+    if (changeCallbacks.length() == 0)
+        return;
+
+    MMessage::removeCallbacks(changeCallbacks);
+    changeCallbacks.clear();
+
+    changedNodes.clear();
+    sceneParsed = false;
+}
+
+void MayaScene::logChangedNode(const MObject& node)
+{
+    if (!sceneParsed || changeLogOverflow)
+        return;
+
+    if (changedNodes.size() >= ChangeLogCapacity)
+    {
+        changeLogOverflow = true;
+        changedNodes.clear();
+        return;
     }
 
-    return true;
+    changedNodes.push_back(MObjectHandle(node));
 }
 
-bool MayaScene::updateScene()
+void MayaScene::dagChangedCallback(MDagMessage::DagMessage msgType, MDagPath& child, MDagPath& parent, void* clientData)
 {
-    updateScene(MFn::kShape);
-    updateScene(MFn::kTransform);
+    static_cast<MayaScene*>(clientData)->logChangedNode(child.node());
+}
 
-    for (size_t camId = 0; camId < camList.size(); camId++)
+void MayaScene::nodeRemovedCallback(MObject& node, void* clientData)
+{
+    static_cast<MayaScene*>(clientData)->logChangedNode(node);
+}
+
+void MayaScene::nameChangedCallback(MObject& node, const MString& prevName, void* clientData)
+{
+    if (node.hasFn(MFn::kDagNode))
+        static_cast<MayaScene*>(clientData)->logChangedNode(node);
+}
+
+void MayaScene::connectionCallback(MPlug& srcPlug, MPlug& destPlug, bool made, void* clientData)
+{
+    MayaScene* scene = static_cast<MayaScene*>(clientData);
+    const MObject srcNode = srcPlug.node();
+    const MObject destNode = destPlug.node();
+
+    // Light links are stored as connections to the light linker.
+    if (srcNode.hasFn(MFn::kLightLink) || destNode.hasFn(MFn::kLightLink))
     {
-        boost::shared_ptr<MayaObject> obj = camList[camId];
-        obj->updateObject();
+        scene->lightLinksChanged = true;
+        return;
+    }
+
+    // Connections decide if objects are animated or instanced.
+    if (srcNode.hasFn(MFn::kDagNode))
+        scene->logChangedNode(srcNode);
+    if (destNode.hasFn(MFn::kDagNode))
+        scene->logChangedNode(destNode);
+}
+
+boost::shared_ptr<MayaObject> MayaScene::findObject(const MDagPath& dagPath) const
+{
+    typedef MayaObjectMultiMap::const_iterator Iterator;
+    const std::pair<Iterator, Iterator> range = nodeObjects.equal_range(MObjectHandle(dagPath.node()));
+
+    for (Iterator i = range.first; i != range.second; ++i)
+    {
+        if (i->second->dagPath == dagPath)
+            return i->second;
+    }
+
+    return boost::shared_ptr<MayaObject>();
+}
 
-        if (!getWorldPtr()->mRenderGlobals->isMbStartStep())
+// Re-parse the subtrees of all logged nodes. Everything else, including the
+// names and attributes of the objects, is kept from the previous parse.
+bool MayaScene::parseChanges()
+{
+    const bool structureChanged = !changedNodes.empty();
+
+    if (structureChanged)
+    {
+        MayaObjectSet removedObjects;
+        MObjectHandleSet pendingNodes;
+        for (size_t i = 0; i < changedNodes.size(); ++i)
         {
-            if (!obj->motionBlurred)
+            const MObjectHandle& handle = changedNodes[i];
+            if (!handle.isAlive())
                 continue;
+
+            pendingNodes.insert(handle);
+
+            typedef MayaObjectMultiMap::const_iterator Iterator;
+            const std::pair<Iterator, Iterator> range = nodeObjects.equal_range(handle);
+            for (Iterator o = range.first; o != range.second; ++o)
+                removedObjects.insert(o->second.get());
         }
 
-        if (getWorldPtr()->mRenderGlobals->isTransformStep())
+        // Cameras, lights and instancers are leaves, their parents are in the object list.
+        removeObjects(objectList, removedObjects);
+        removeObjects(camList, removedObjects);
+        removeObjects(lightList, removedObjects);
+        removeObjects(instancerList, removedObjects);
+        removeObjects(nodeObjects, removedObjects);
+        removeObjects(origObjects, removedObjects);
+
+        // The other instances of a removed node refer to the removed objects through origObject.
+        for (MayaObjectSet::const_iterator i = removedObjects.begin(); i != removedObjects.end(); ++i)
         {
-            if (getWorldPtr()->mRenderGlobals->isMbStartStep())
-                obj->transformMatrices.clear();
-            obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
-            getWorldPtr()->mRenderer->updateTransform(obj);
+            const MObjectHandle handle((*i)->mobject);
+            if (handle.isAlive() && nodeObjects.count(handle) > 0)
+                return false;
         }
-    }
 
-    std::vector<boost::shared_ptr<MayaObject> >::iterator mIter;
-    for (mIter = lightList.begin(); mIter != lightList.end(); mIter++)
-    {
-        boost::shared_ptr<MayaObject> obj = *mIter;
-        obj->updateObject();
+        Logging::debug(
+            MString("Scene changes: ") + static_cast<int>(changedNodes.size()) + " changed nodes, " +
+            static_cast<int>(removedObjects.size()) + " objects removed.");
 
-        if (!getWorldPtr()->mRenderGlobals->isMbStartStep())
+        for (MObjectHandleSet::const_iterator i = pendingNodes.begin(); i != pendingNodes.end(); ++i)
         {
-            if (!obj->motionBlurred)
+            const MObject node = i->object();
+            if (!node.hasFn(MFn::kDagNode))
                 continue;
-        }
 
-        if (getWorldPtr()->mRenderGlobals->isTransformStep())
-        {
-            if (getWorldPtr()->mRenderGlobals->isMbStartStep())
-                obj->transformMatrices.clear();
-            obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
-            getWorldPtr()->mRenderer->updateShape(obj);
+            MDagPathArray paths;
+            MDagPath::getAllPathsTo(node, paths);
+
+            for (uint p = 0; p < paths.length(); p++)
+            {
+                // Already parsed as part of the subtree of another changed node.
+                if (findObject(paths[p]))
+                    continue;
+
+                MDagPath parentPath = paths[p];
+                parentPath.pop();
+
+                const boost::shared_ptr<MayaObject> parentObject = findObject(parentPath);
+                if (!parentObject)
+                {
+                    // The parent is changed too and will parse this path as part of its subtree.
+                    if (pendingNodes.count(MObjectHandle(parentPath.node())) > 0)
+                        continue;
+
+                    return false;
+                }
+
+                parseSceneHierarchy(paths[p], paths[p].length(), parentObject->attributes, parentObject);
+            }
         }
     }
 
-    if (getWorldPtr()->mRenderGlobals->isTransformStep())
-        updateInstancer();
+    parseInstancerNew();
+
+    if (structureChanged || lightLinksChanged)
+        getLightLinking();
+
+    changedNodes.clear();
+    lightLinksChanged = false;
 
     return true;
 }
 
-bool MayaScene::updateInstancer()
+// Fill the transform motion samples of all objects without changing the current time.
+// Only objects whose world matrix can change are evaluated at the sample times,
+// all others keep the single matrix of the current frame.
+void MayaScene::sampleTransforms(const boost::shared_ptr<MayaObject>& obj, const float frame)
 {
-    // updates only required for a transform step
-    if (!getWorldPtr()->mRenderGlobals->isTransformStep())
-        return true;
+    obj->transformMatrices.clear();
+
+    if (!getWorldPtr()->mRenderGlobals->doMb || !obj->motionBlurred || !obj->transformAnimated)
+    {
+        obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
+        return;
+    }
+
+    const std::vector<MbElement>& steps = getWorldPtr()->mRenderGlobals->mbElementList;
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        if (steps[i].elementType == MbElement::MotionBlurXForm || steps[i].elementType == MbElement::MotionBlurBoth)
+            obj->transformMatrices.push_back(getWorldMatrixAtTime(obj->dagPath, MTime(frame + steps[i].time, MTime::uiUnit())));
+    }
+
+    if (obj->transformMatrices.empty())
+        obj->transformMatrices.push_back(obj->dagPath.inclusiveMatrix());
+}
+
+bool MayaScene::sampleScene(const float frame)
+{
+    MayaObject::invalidateVisibility();
 
-    size_t numElements = this->instancerNodeElements.size();
-    for (size_t i = 0; i < numElements; i++)
+    for (size_t objId = 0; objId < objectList.size(); objId++)
     {
-        boost::shared_ptr<MayaObject> obj = this->instancerNodeElements[i];
-        MMatrix origMatrix;
-        origMatrix.setToIdentity();
-        if (obj->origObject != 0)
+        const boost::shared_ptr<MayaObject>& obj = objectList[objId];
+        obj->updateObject();
+        if (obj->mobject.hasFn(MFn::kShape))
+            getWorldPtr()->mRenderer->updateShape(obj);
+        if (obj->mobject.hasFn(MFn::kTransform))
         {
-            origMatrix = obj->origObject->dagPath.inclusiveMatrix();
-            origMatrix.inverse();
+            sampleTransforms(obj, frame);
+            getWorldPtr()->mRenderer->updateTransform(obj);
         }
-        MFnInstancer instFn(obj->instancerDagPath);
-        MDagPathArray dagPathArray;
-        MMatrix matrix;
-        instFn.instancesForParticle(obj->instancerParticleId, dagPathArray, matrix);
-        for (uint k = 0; k < dagPathArray.length(); k++)
-            Logging::debug(MString("Particle mobj id: ") + i + "particle id: " + obj->instancerParticleId + " path id " + k + " - " + dagPathArray[k].fullPathName());
-        if (getWorldPtr()->mRenderGlobals->isMbStartStep())
-            obj->transformMatrices.clear();
-
-        obj->transformMatrices.push_back(origMatrix * matrix);
+    }
+
+    for (size_t camId = 0; camId < camList.size(); camId++)
+    {
+        const boost::shared_ptr<MayaObject>& obj = camList[camId];
+        obj->updateObject();
+        sampleTransforms(obj, frame);
         getWorldPtr()->mRenderer->updateTransform(obj);
     }
+
+    for (size_t lightId = 0; lightId < lightList.size(); lightId++)
+    {
+        const boost::shared_ptr<MayaObject>& obj = lightList[lightId];
+        obj->updateObject();
+        sampleTransforms(obj, frame);
+        getWorldPtr()->mRenderer->updateShape(obj);
+    }
+
+    sampleInstancers(frame);
+
     return true;
 }
 
-// parsing all particle instancer nodes in the scene
-// here I put all nodes created by an instancer node into a array of its own.
-// The reason why I don't simply add it to the main list is that I have to recreate them
-// during sceneUpdate() for every frame because the list can change with the birth or death
-// of a particle
+// Parse all particle instancer nodes in the scene. The instances are rebuilt for
+// every frame because particles can be born or die, they only get the particle
+// matrices of the current frame here; sampleInstancers() fills their transforms.
 bool MayaScene::parseInstancerNew()
 {
-    // if we have any previously defined instancer elements, delete it
-    instancerNodeElements.clear();
+    instancerInstances.clear();
 
-    for (int iId = 0; iId < instancerDagPathList.size(); iId++)
+    for (size_t iId = 0; iId < instancerList.size(); iId++)
     {
-        MDagPath instPath = instancerDagPathList[iId];
-        MObject instancerMObject = instPath.node();
-        MString path = instPath.fullPathName();
-        MFnInstancer instFn(instPath);
-        int numParticles = instFn.particleCount();
-        Logging::debug(MString("Detected instancer. instPath: ") + path + " it has " + numParticles + " particle instances");
+        const boost::shared_ptr<MayaObject>& instancer = instancerList[iId];
+        MFnInstancer instFn(instancer->dagPath);
+
         MDagPathArray allPaths;
-        MMatrixArray allMatrices;
-        MIntArray pathIndices;
         MIntArray pathStartIndices;
-        MObjectArray nodeList;
-        getConnectedInNodes(MString("inputPoints"), instPath.node(), nodeList);
-        bool hasParticleSystem = false;
-        MVectorArray rgbPP;
-        if (nodeList.length() > 0)
-        {
-            if (nodeList[0].hasFn(MFn::kParticle))
-            {
-                Logging::debug(MString("Found a particle system called ") + getObjectName(nodeList[0]));
-                MStatus stat;
-                MFnParticleSystem pSystem(nodeList[0], &stat);
-                if (stat)
-                {
-                    if (pSystem.hasRgb())
-                    {
-                        hasParticleSystem = true;
-                        pSystem.rgb(rgbPP);
-                    }
-                }
-                else
-                {
-                    Logging::debug(MString("Could nod get a particleSystem from node "));
-                }
-            }
-        }
+        MIntArray pathIndices;
+
+        instancerInstances.push_back(InstancerInstances());
+        InstancerInstances& instances = instancerInstances.back();
+        instances.instancer = instancer;
 
         // give me all instances in this instancer
-        instFn.allInstances(allPaths, allMatrices, pathStartIndices, pathIndices);
+        instFn.allInstances(allPaths, instances.particleMatrices, pathStartIndices, pathIndices);
+
+        // Find the assembly of every instanced path once, whatever the number of particles instancing it.
+        std::vector<int> pathPrototypes(allPaths.length(), -1);
+        for (unsigned int i = 0; i < allPaths.length(); i++)
+        {
+            const MayaObjectMap::const_iterator orig = origObjects.find(MObjectHandle(allPaths[i].node()));
+            if (orig == origObjects.end() || !orig->second->attributes)
+                continue;
 
-        for (int p = 0; p < numParticles; p++)
+            MayaObject* assemblyObject = orig->second->attributes->assemblyObject;
+            if (assemblyObject == 0 || assemblyObject->mobject.hasFn(MFn::kWorld))
+                continue;
+
+            const std::vector<MayaObject*>::const_iterator prototype =
+                std::find(instances.prototypes.begin(), instances.prototypes.end(), assemblyObject);
+            pathPrototypes[i] = static_cast<int>(prototype - instances.prototypes.begin());
+            if (prototype == instances.prototypes.end())
+                instances.prototypes.push_back(assemblyObject);
+        }
+
+        //  the paths instanced under particle p are allPaths[pathIndices[pathStartIndices[p]...pathStartIndices[p + 1]]].
+        //  The size of the start index array is always one larger than the number of particles.
+        const unsigned int numParticles = instances.particleMatrices.length();
+        for (unsigned int p = 0; p < numParticles; p++)
         {
-            MMatrix particleMatrix = allMatrices[p];
-
-            //  the number of paths instanced under a particle is computed by
-            //  taking the difference between the starting path index for this
-            //  particle and that of the next particle.  The size of the start
-            //  index array is always one larger than the number of particles.
-            //
-            int numPaths = pathStartIndices[p + 1] - pathStartIndices[p];
-
-            //  the values pathIndices[pathStart...pathStart+numPaths] give the
-            //  indices in the allPaths array of the paths instanced under this
-            //  particular particle.  Remember, different paths can be instanced
-            //  under each particle.
-            //
-            int pathStart = pathStartIndices[p];
-
-            //  loop through the instanced paths for this particle
-            boost::shared_ptr<ObjectAttributes> currentAttributes;
-            for (int i = pathStart; i < pathStart + numPaths; i++)
+            const size_t firstInstance = instances.prototypeIndices.size();
+            for (int i = pathStartIndices[p]; i < pathStartIndices[p + 1]; i++)
             {
-                int curPathIndex = pathIndices[i];
-                MDagPath curPath = allPaths[curPathIndex];
-
-                boost::shared_ptr<MayaObject> particleMObject(new MayaObject(curPath));
-                MFnDependencyNode pOrigNode(particleMObject->mobject);
-                MObject pOrigObject = pOrigNode.object();
-
-                // search for the correct orig MayaObject element
-                // todo: visibiliy check - necessary?
-                boost::shared_ptr<MayaObject> origObj;
-                std::vector<boost::shared_ptr<MayaObject> > ::iterator mIter = origObjects.begin();
-                for (; mIter != origObjects.end(); mIter++)
-                {
-                    boost::shared_ptr<MayaObject> obj = *mIter;
-                    if (obj->mobject == pOrigObject)
-                    {
-                        origObj = obj;
-                    }
-                }
-                if (origObj == 0)
-                {
-                    Logging::debug(MString("Orig particle instancer obj not found."));
+                const int prototype = pathPrototypes[pathIndices[i]];
+                if (prototype < 0)
                     continue;
-                }
-                currentAttributes = particleMObject->getObjectAttributes(origObj->attributes);
-                particleMObject->origObject = origObj;
-                particleMObject->isInstancerObject = true;
-                particleMObject->visible = true;
-                particleMObject->instancerParticleId = p;
-                particleMObject->instanceNumber = p + 1; // instanceNumber has to be at least 1, 0 indicates original object
-                particleMObject->instancerDagPath = instPath;
-                particleMObject->dagPath = curPath;
-                particleMObject->instancerMObj = instancerMObject;
-                particleMObject->fullName = origObj->fullName + "_i_" + p;
-                particleMObject->shortName = origObj->shortName + "_i_" + p;
-                particleMObject->transformMatrices.clear();
-                particleMObject->transformMatrices.push_back(particleMatrix);
-
-                this->instancerNodeElements.push_back(particleMObject);
-                currentAttributes->hasInstancerConnection = true;
-                if (hasParticleSystem)
-                {
-                    if (particleMObject->attributes != 0)
-                    {
-                        particleMObject->attributes->hasColorOverride = true;
-                        particleMObject->attributes->colorOverride = MColor(rgbPP[p].x, rgbPP[p].y, rgbPP[p].z);
-                    }
-                }
+
+                if (std::find(instances.prototypeIndices.begin() + firstInstance, instances.prototypeIndices.end(), static_cast<unsigned int>(prototype)) != instances.prototypeIndices.end())
+                    continue;
+
+                instances.prototypeIndices.push_back(static_cast<unsigned int>(prototype));
+                instances.particleIndices.push_back(p);
             }
         }
+
+        Logging::debug(
+            MString("Instancer ") + instancer->shortName + ": " + static_cast<int>(numParticles) + " particles, " +
+            static_cast<int>(instances.size()) + " instances of " + static_cast<int>(instances.prototypes.size()) + " assemblies.");
     }
 
     return true;
 }
+
+namespace
+{
+    // Compute the transforms of all instances of an instancer for a transform
+    // motion step at the current time.
+    void sampleInstancerStep(InstancerInstances& instances, const size_t step)
+    {
+        MFnInstancer instFn(instances.instancer->dagPath);
+        MDagPathArray allPaths;
+        MMatrixArray particleMatrices;
+        MIntArray pathStartIndices;
+        MIntArray pathIndices;
+        instFn.allInstances(allPaths, particleMatrices, pathStartIndices, pathIndices);
+
+        // If particles are born or die at this time, the particle indices don't
+        // match anymore and the instances keep the matrices of the current frame.
+        const MMatrixArray& matrices =
+            particleMatrices.length() == instances.particleMatrices.length()
+                ? particleMatrices
+                : instances.particleMatrices;
+
+        std::vector<MMatrix> prototypeMatrices(instances.prototypes.size());
+        for (size_t i = 0; i < instances.prototypes.size(); i++)
+            prototypeMatrices[i] = instances.prototypes[i]->dagPath.inclusiveMatrix();
+
+        for (size_t i = 0; i < instances.size(); i++)
+            instances.matrices[i * instances.stepCount + step] = prototypeMatrices[instances.prototypeIndices[i]] * matrices[instances.particleIndices[i]];
+    }
+}
+
+// Particle instances can only be queried at the current time, so with motion
+// blur the time is stepped through the transform motion steps and set back.
+void MayaScene::sampleInstancers(const float frame)
+{
+    if (instancerInstances.empty())
+        return;
+
+    const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+    std::vector<double> stepTimes;
+    if (renderGlobals->doMb)
+    {
+        for (size_t i = 0; i < renderGlobals->mbElementList.size(); i++)
+        {
+            const MbElement& element = renderGlobals->mbElementList[i];
+            if (element.elementType == MbElement::MotionBlurXForm || element.elementType == MbElement::MotionBlurBoth)
+                stepTimes.push_back(element.time);
+        }
+    }
+    if (stepTimes.empty())
+        stepTimes.push_back(0.0);
+
+    for (size_t iId = 0; iId < instancerInstances.size(); iId++)
+    {
+        instancerInstances[iId].stepCount = stepTimes.size();
+        instancerInstances[iId].matrices.resize(stepTimes.size() * instancerInstances[iId].size());
+    }
+
+    bool timeChanged = false;
+    for (size_t step = 0; step < stepTimes.size(); step++)
+    {
+        if (stepTimes[step] != 0.0 || timeChanged)
+        {
+            MGlobal::viewFrame(frame + stepTimes[step]);
+            timeChanged = true;
+        }
+
+        for (size_t iId = 0; iId < instancerInstances.size(); iId++)
+            sampleInstancerStep(instancerInstances[iId], step);
+    }
+
+    if (timeChanged)
+        MGlobal::viewFrame(frame);
+}
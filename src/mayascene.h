@@ -30,19 +30,29 @@
 #define MAYASCENE_H
 
 // appleseed-maya headers.
+#include "utilities/hashtools.h"
 #include "mayaobject.h"
 
 // Maya headers.
+#include <maya/MCallbackIdArray.h>
+#include <maya/MDagMessage.h>
 #include <maya/MDagPath.h>
+#include <maya/MMatrix.h>
+#include <maya/MMatrixArray.h>
 #include <maya/MMessage.h>
 #include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+
+// Boost headers.
+#include "boost/shared_ptr.hpp"
+#include "boost/unordered_map.hpp"
 
 // Standard headers.
 #include <map>
 #include <vector>
 
 // Forward declarations.
-class MDagPathArray;
+class MPlug;
 
 class EditableElement
 {
@@ -64,13 +74,35 @@ class EditableElement
     }
 };
 
+// All instances of a particle instancer, read in bulk with MFnInstancer::allInstances().
+// An instance places the assembly of one prototype at one particle, several paths
+// instanced under the same particle and translated into the same assembly share it.
+struct InstancerInstances
+{
+    boost::shared_ptr<MayaObject>   instancer;
+    std::vector<MayaObject*>        prototypes;         // assembly objects of the instanced paths
+    std::vector<unsigned int>       prototypeIndices;   // per instance
+    std::vector<unsigned int>       particleIndices;    // per instance
+    MMatrixArray                    particleMatrices;   // per particle, at the current frame
+    std::vector<MMatrix>            matrices;           // per instance, then per transform motion step
+    size_t                          stepCount;
+
+    InstancerInstances()
+      : stepCount(0)
+    {
+    }
+
+    size_t size() const { return particleIndices.size(); }
+    const MMatrix& getMatrix(const size_t step, const size_t instance) const { return matrices[instance * stepCount + step]; }
+};
+
 class MayaScene
 {
   public:
     std::vector<boost::shared_ptr<MayaObject> > objectList;
     std::vector<boost::shared_ptr<MayaObject> > camList;
     std::vector<boost::shared_ptr<MayaObject> > lightList;
-    std::vector<boost::shared_ptr<MayaObject> > instancerNodeElements; // so its easier to update them
+    std::vector<InstancerInstances> instancerInstances;
 
     // This map allows node callbacks to retrieve MayaObjects associated to nodes.
     typedef std::map<MCallbackId, EditableElement> EditableElementContainer;
@@ -82,19 +114,43 @@ class MayaScene
     MDagPath uiCamera;
 
     MayaScene();
+    ~MayaScene();
 
     bool parseSceneHierarchy(MDagPath currentObject, int level, boost::shared_ptr<ObjectAttributes> attr, boost::shared_ptr<MayaObject> parentObject);
     bool parseScene();
-    bool updateScene();
+    bool sampleScene(const float frame); // update all objects for the given frame, only instancers change the current time
+
+    // While change tracking is on, DAG changes are logged and parseScene() only re-parses
+    // the changed parts of the scene. Used to keep the scene across the frames of a sequence.
+    void startChangeTracking();
+    void stopChangeTracking();
 
   private:
-    std::vector<boost::shared_ptr<MayaObject> > origObjects;
-    std::vector<MDagPath> instancerDagPathList;
+    typedef boost::unordered_map<MObjectHandle, boost::shared_ptr<MayaObject>, MObjectHandleHash> MayaObjectMap;
+    typedef boost::unordered_multimap<MObjectHandle, boost::shared_ptr<MayaObject>, MObjectHandleHash> MayaObjectMultiMap;
+    MayaObjectMap origObjects;  // the object of the first instance of every DAG node
+    MayaObjectMultiMap nodeObjects; // the objects of all instances of every DAG node
+    std::vector<boost::shared_ptr<MayaObject> > instancerList;
+
+    // Change log, only filled while change tracking is on.
+    MCallbackIdArray changeCallbacks;
+    std::vector<MObjectHandle> changedNodes;
+    bool changeLogOverflow;
+    bool lightLinksChanged;
+    bool sceneParsed;           // the objects match the DAG, except for the logged changes
+
+    void logChangedNode(const MObject& node);
+    bool parseChanges();        // return false if a full parse is needed
+    boost::shared_ptr<MayaObject> findObject(const MDagPath& dagPath) const;
+
+    static void dagChangedCallback(MDagMessage::DagMessage msgType, MDagPath& child, MDagPath& parent, void* clientData);
+    static void nodeRemovedCallback(MObject& node, void* clientData);
+    static void connectionCallback(MPlug& srcPlug, MPlug& destPlug, bool made, void* clientData);
+    static void nameChangedCallback(MObject& node, const MString& prevName, void* clientData);
 
     void getLightLinking();
-    bool lightObjectIsInLinkedLightList(boost::shared_ptr<MayaObject> lightObject, MDagPathArray& linkedLightsArray);
-    bool updateInstancer(); // update all necessary objects
-    bool updateScene(MFn::Type updateElement); // update all necessary objects
+    void sampleTransforms(const boost::shared_ptr<MayaObject>& obj, const float frame);
+    void sampleInstancers(const float frame);
     bool parseInstancerNew(); // parse only particle instancer nodes, its a bit more complex
 };
 
@@ -37,26 +37,19 @@
 // Maya headers.
 #include <maya/MBoundingBox.h>
 #include <maya/MMatrix.h>
-#include <maya/MItMeshPolygon.h>
 #include <maya/MGlobal.h>
 
 MeshWalker::MeshWalker(const MDagPath& dagPath)
   : mMeshDagPath(dagPath)
 {
-    mMeshObject = dagPath.node();
-
-    MObject smoothMesh = checkSmoothMesh();
-    if (smoothMesh != MObject::kNullObj)
-        mMeshObject = smoothMesh;
+    // Use the same smooth mesh as a rendered mesh, the per face assignments depend on it.
+    mMeshObject = getRenderMesh(dagPath.node(), mSmoothMeshData);
 
     mMeshFn.setObject(mMeshObject);
 
     getObjectShadingGroups(dagPath, mPerFaceAssignments, mShadingGroups, true);
 
     MStatus stat;
-    MItMeshPolygon faceIt(mMeshObject, &stat);
-    CHECK_MSTATUS(stat);
-
     stat = mMeshFn.getPoints(mPoints);
     if (!stat)
         MGlobal::displayError(MString("MeshWalker: getPoints: ") + stat.errorString());
@@ -69,66 +62,7 @@ MeshWalker::MeshWalker(const MDagPath& dagPath)
     if (!stat)
         MGlobal::displayError(MString("MeshWalker: getUvs: ") + stat.errorString());
 
-    MPointArray triPoints;
-    MIntArray triVtxIds;
-    MIntArray faceVtxIds;
-    MIntArray faceNormalIds;
-
-    for (faceIt.reset(); !faceIt.isDone(); faceIt.next())
-    {
-        int faceId = faceIt.index();
-        int numTris;
-        faceIt.numTriangles(numTris);
-        faceIt.getVertices(faceVtxIds);
-
-        MIntArray faceUVIndices;
-
-        faceNormalIds.clear();
-        for (uint vtxId = 0; vtxId < faceVtxIds.length(); vtxId++)
-        {
-            faceNormalIds.append(faceIt.normalIndex(vtxId));
-            int uvIndex;
-            faceIt.getUVIndex(vtxId, uvIndex);
-            faceUVIndices.append(uvIndex);
-        }
-
-        for (int triId = 0; triId < numTris; triId++)
-        {
-            int faceRelIds[3];
-            faceIt.getTriangle(triId, triPoints, triVtxIds);
-
-            for (uint triVtxId = 0; triVtxId < 3; triVtxId++)
-            {
-                for (uint faceVtxId = 0; faceVtxId < faceVtxIds.length(); faceVtxId++)
-                {
-                    if (faceVtxIds[faceVtxId] == triVtxIds[triVtxId])
-                        faceRelIds[triVtxId] = faceVtxId;
-                }
-            }
-
-            const unsigned int vtxId0 = faceVtxIds[faceRelIds[0]];
-            const unsigned int vtxId1 = faceVtxIds[faceRelIds[1]];
-            const unsigned int vtxId2 = faceVtxIds[faceRelIds[2]];
-            const unsigned int normalId0 = faceNormalIds[faceRelIds[0]];
-            const unsigned int normalId1 = faceNormalIds[faceRelIds[1]];
-            const unsigned int normalId2 = faceNormalIds[faceRelIds[2]];
-            const unsigned int uvId0 = faceUVIndices[faceRelIds[0]];
-            const unsigned int uvId1 = faceUVIndices[faceRelIds[1]];
-            const unsigned int uvId2 = faceUVIndices[faceRelIds[2]];
-
-            Face f;
-            f.vtxIds.append(vtxId0);
-            f.vtxIds.append(vtxId1);
-            f.vtxIds.append(vtxId2);
-            f.normalIds.append(normalId0);
-            f.normalIds.append(normalId1);
-            f.normalIds.append(normalId2);
-            f.uvIds.append(uvId0);
-            f.uvIds.append(uvId1);
-            f.uvIds.append(uvId2);
-            mFaceList.push_back(f);
-        }
-    }
+    triangulateMesh(mMeshFn, mPerFaceAssignments, mTriangles);
 }
 
 void MeshWalker::applyTransform()
@@ -191,7 +125,7 @@ const char* MeshWalker::get_material_slot(const size_t i) const
 
 size_t MeshWalker::get_face_count() const
 {
-    return mFaceList.size();
+    return mTriangles.size();
 }
 
 size_t MeshWalker::get_face_vertex_count(const size_t face_index) const
@@ -201,61 +135,20 @@ size_t MeshWalker::get_face_vertex_count(const size_t face_index) const
 
 size_t MeshWalker::get_face_vertex(const size_t face_index, const size_t vertex_index) const
 {
-    return mFaceList[face_index].vtxIds[static_cast<unsigned int>(vertex_index)];
+    return mTriangles.pointIndices[static_cast<unsigned int>(face_index * 3 + vertex_index)];
 }
 
 size_t MeshWalker::get_face_vertex_normal(const size_t face_index, const size_t vertex_index) const
 {
-    return mFaceList[face_index].normalIds[static_cast<unsigned int>(vertex_index)];
+    return mTriangles.normalIndices[static_cast<unsigned int>(face_index * 3 + vertex_index)];
 }
 
 size_t MeshWalker::get_face_tex_coords(const size_t face_index, const size_t vertex_index) const
 {
-    return mFaceList[face_index].uvIds[static_cast<unsigned int>(vertex_index)];
+    return mTriangles.uvIndices[static_cast<unsigned int>(face_index * 3 + vertex_index)];
 }
 
 size_t MeshWalker::get_face_material(const size_t face_index) const
 {
     return 0;
 }
-
-MObject MeshWalker::checkSmoothMesh()
-{
-    MStatus stat;
-
-    MFnMesh mesh(mMeshObject, &stat);
-    if (!stat)
-    {
-        MGlobal::displayError(MString("checkSmoothMesh: could not get mesh: ") + stat.errorString());
-        return MObject::kNullObj;
-    }
-
-    bool displaySmoothMesh = false;
-    if (getBool("displaySmoothMesh", mesh, displaySmoothMesh))
-    {
-        if (!displaySmoothMesh)
-            return MObject::kNullObj;
-    }
-    else
-    {
-        MGlobal::displayError("checkSmoothMesh: could not get displaySmoothMesh attr ");
-        return MObject::kNullObj;
-    }
-
-    MObject meshDataObj = mSmoothMeshData.create();
-    MObject smoothMeshObj = mesh.generateSmoothMesh(meshDataObj, &stat);
-    if (!stat)
-    {
-        MGlobal::displayError("checkSmoothMesh: failed");
-        return MObject::kNullObj;
-    }
-
-    MFnMesh smoothMeshDn(smoothMeshObj, &stat);
-    if (!stat)
-    {
-        MGlobal::displayError(MString("checkSmoothMesh: could not create smoothMeshDn: ") + stat.errorString());
-        return MObject::kNullObj;
-    }
-
-    return smoothMeshObj;
-}
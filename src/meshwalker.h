@@ -29,6 +29,9 @@
 #ifndef MESHWALKER_H
 #define MESHWALKER_H
 
+// appleseed-maya headers.
+#include "utilities/meshtools.h"
+
 // appleseed.foundation headers.
 #include "foundation/math/vector.h"
 #include "foundation/mesh/imeshwalker.h"
@@ -39,7 +42,6 @@
 #include <maya/MFloatArray.h>
 #include <maya/MFloatVectorArray.h>
 #include <maya/MFnMesh.h>
-#include <maya/MFnMeshData.h>
 #include <maya/MIntArray.h>
 #include <maya/MObject.h>
 #include <maya/MObjectArray.h>
@@ -92,26 +94,17 @@ class MeshWalker
     virtual size_t get_face_material(const size_t face_index) const APPLESEED_OVERRIDE;
 
   private:
-    struct Face
-    {
-        MIntArray       vtxIds;
-        MIntArray       normalIds;
-        MIntArray       uvIds;
-    };
-
     MFnMesh             mMeshFn;
     MDagPath            mMeshDagPath;
     MObject             mMeshObject;
-    MFnMeshData         mSmoothMeshData;
+    MObject             mSmoothMeshData;    // owns mMeshObject if the mesh is smoothed
 
     MFloatArray         mU, mV;
     MPointArray         mPoints;
     MFloatVectorArray   mNormals;
     MObjectArray        mShadingGroups;
     MIntArray           mPerFaceAssignments;
-    std::vector<Face>   mFaceList;
-
-    MObject checkSmoothMesh();
+    MeshTriangles       mTriangles;
 };
 
 #endif  // !MESHWALKER_H
@@ -30,6 +30,7 @@
 #include "shaders/asdisneymaterial.h"
 #include "shaders/asdisneymaterialoverride.h"
 #include "shaders/aslayeredshader.h"
+#include "utilities/attrtools.h"
 #include "utilities/tools.h"
 #include "appleseedmaya.h"
 #include "binmeshreadercmd.h"
@@ -77,6 +78,9 @@ APPLESEEDMAYA_DLL_EXPORT MStatus initializePlugin(MObject obj)
     MFnPlugin plugin(obj, VENDOR, versions[0].c_str(), "Any");
     MStatus status;
 
+    status = initializeAttributeCache();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     status =
         plugin.registerFileTranslator(
             "appleseedBinaryMesh",
@@ -195,6 +199,8 @@ APPLESEEDMAYA_DLL_EXPORT MStatus uninitializePlugin(MObject obj)
 
     deleteWorld();
 
+    uninitializeAttributeCache();
+
     status = MGlobal::executePythonCommand("import appleseed_maya.initialize; appleseed_maya.initialize.unregister()");
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
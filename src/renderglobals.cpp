@@ -64,6 +64,7 @@ RenderGlobals::RenderGlobals()
     geotimesamples = 2;
     createDefaultLight = false;
     exportSceneFile = false;
+    exportMode = 0;
     adaptiveSampling = false;
     imageName = "";
     basePath = "";
@@ -74,8 +75,14 @@ RenderGlobals::RenderGlobals()
     currentFrameIndex = 0;
     sceneScale = 1.0f;
     filterSize = 3.0f;
+    displayQueuePolicy = 2; // coalesce
+    progressiveEdgeInterval = 4;
+    deduplicateMeshes = false;
+    velocitySources.clear();
 
     getDefaultGlobals();
+    getRenderSettings();
+    getEnvironmentSettings();
 
     float internalScaleFactor = 1.0f;   // in mm
 
@@ -326,11 +333,12 @@ void RenderGlobals::getDefaultGlobals()
     doMb = getBoolAttr("doMotionBlur", depFn, false);
     doDof = getBoolAttr("doDof", depFn, false);
     motionBlurRange = getFloatAttr("motionBlurRange", depFn, 0.4f);
-    motionBlurType = 0; // center
+    motionBlurType = getEnumInt("motionBlurType", depFn);
     xftimesamples = getIntAttr("xftimesamples", depFn, 2);
     geotimesamples = getIntAttr("geotimesamples", depFn, 2);
     createDefaultLight = false;
     exportSceneFile = getBoolAttr("exportSceneFile", depFn, false);
+    exportMode = getEnumInt("exportMode", depFn);
     adaptiveSampling = getBoolAttr("adaptiveSampling", depFn, false);
     imageName = getStringAttr("imageName", depFn, "");
     basePath = getStringAttr("basePath", depFn, "");
@@ -339,8 +347,71 @@ void RenderGlobals::getDefaultGlobals()
     threads = getIntAttr("threads", depFn, 4);
     translatorVerbosity = getEnumInt("translatorVerbosity", depFn);
     rendererVerbosity = getEnumInt("rendererVerbosity", depFn);
+    displayQueuePolicy = getEnumInt("displayQueuePolicy", depFn);
+    progressiveEdgeInterval = getIntAttr("progressiveEdgeInterval", depFn, 4);
+    deduplicateMeshes = getBoolAttr("deduplicateMeshes", depFn, false);
+    velocitySources.clear();
+    getStringAttr("velocitySources", depFn, "bifrostVelocity velocityPV velocities").split(' ', velocitySources);
     useSunLightConnection = getBoolAttr("useSunLightConnection", depFn, false);
     tilesize = getIntAttr("tileSize", depFn, 64);
     sceneScale = getFloatAttr("sceneScale", depFn, 1.0f);
     filterSize = getFloatAttr("filterSize", depFn, 3.0f);
 }
+
+void RenderGlobals::getRenderSettings()
+{
+    MFnDependencyNode depFn(getRenderGlobalsNode());
+    lightingEngine = getEnumInt("lightingEngine", depFn);
+    pixelRenderer = getEnumInt("pixel_renderer", depFn);
+    samplingMode = getEnumInt("sampling_mode", depFn);
+    tileOrdering = getEnumInt("tile_ordering", depFn);
+    texCacheSize = getIntAttr("texCacheSize", depFn, 128);
+    minSamples = getIntAttr("minSamples", depFn, 1);
+    maxSamples = getIntAttr("maxSamples", depFn, 16);
+    adaptiveQuality = getFloatAttr("adaptiveQuality", depFn, 3.0f);
+    enableDiagnostics = getBoolAttr("enable_diagnostics", depFn, true);
+    frameRendererPasses = getIntAttr("frameRendererPasses", depFn, 1);
+    enableIbl = getBoolAttr("enable_ibl", depFn, true);
+    enableDl = getBoolAttr("enable_dl", depFn, true);
+    nextEventEstimation = getBoolAttr("next_event_estimation", depFn, true);
+    enableCaustics = getBoolAttr("enable_caustics", depFn, true);
+    dlMode = getEnumInt("dl_mode", depFn);
+    directLightSamples = getIntAttr("directLightSamples", depFn, 0);
+    photonType = getEnumInt("photon_type", depFn);
+    sppmAlpha = getFloatAttr("sppmAlpha", depFn, .8f);
+    initialRadius = getFloatAttr("initial_radius", depFn, .5f);
+    photonsPerPass = getIntAttr("photons_per_pass", depFn, 100000);
+    envPhotonsPerPass = getIntAttr("env_photons_per_pass", depFn, 100000);
+    lightPhotonsPerPass = getIntAttr("light_photons_per_pass", depFn, 100000);
+    maxPhotonsPerEstimate = getIntAttr("max_photons_per_estimate", depFn, 100);
+    maxRayIntensity = getFloatAttr("max_ray_intensity", depFn, .5f);
+    maxPathLength = getFloatAttr("max_path_length", depFn, 8.0f);
+    rrMinPathLength = getFloatAttr("rr_min_path_length", depFn, 3.0f);
+    pathTracingMaxPathLength = getFloatAttr("path_tracing_max_path_length", depFn, 8.0f);
+    pathTracingRrMinPathLength = getFloatAttr("path_tracing_rr_min_path_length", depFn, 3.0f);
+    photonTracingMaxPathLength = getFloatAttr("photon_tracing_max_path_length", depFn, 8.0f);
+    photonTracingRrMinPathLength = getFloatAttr("photon_tracing_rr_min_path_length", depFn, 3.0f);
+}
+
+void RenderGlobals::getEnvironmentSettings()
+{
+    MFnDependencyNode depFn(getRenderGlobalsNode());
+    environmentType = getEnumInt("environmentType", depFn);
+    environmentSamples = getIntAttr("environmentSamples", depFn, 1);
+    environmentIntensity = getFloatAttr("environmentIntensity", depFn, 1.0f);
+    environmentColor = getColorAttr("environmentColor", depFn);
+    gradientHorizon = getColorAttr("gradientHorizon", depFn);
+    gradientZenit = getColorAttr("gradientZenit", depFn);
+    latlongHoShift = getFloatAttr("latlongHoShift", depFn, 0.0f);
+    latlongVeShift = getFloatAttr("latlongVeShift", depFn, 0.0f);
+    skyModel = getEnumInt("skyModel", depFn);
+    groundAlbedo = getFloatAttr("ground_albedo", depFn, 0.0f);
+    horizonShift = getFloatAttr("horizon_shift", depFn, 0.0f);
+    luminanceMultiplier = getFloatAttr("luminance_multiplier", depFn, 1.0f);
+    saturationMultiplier = getFloatAttr("saturation_multiplier", depFn, 1.0f);
+    turbidity = getFloatAttr("turbidity", depFn, 2.0f);
+    turbidityMax = getFloatAttr("turbidity_max", depFn, 3.0f);
+    turbidityMin = getFloatAttr("turbidity_min", depFn, 3.0f);
+    sunTheta = getDoubleAttr("sun_theta", depFn, 30.0);
+    sunPhi = getDoubleAttr("sun_phi", depFn, 60.0);
+}
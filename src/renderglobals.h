@@ -30,8 +30,10 @@
 #define RENDERGLOBALS_H
 
 // Maya headers.
+#include <maya/MColor.h>
 #include <maya/MObject.h>
 #include <maya/MString.h>
+#include <maya/MStringArray.h>
 #include <maya/MMatrix.h>
 #include <maya/MDistance.h>
 
@@ -123,6 +125,8 @@ class RenderGlobals
     int tilesize;
     int translatorVerbosity;
     int rendererVerbosity;
+    int displayQueuePolicy;     // Block, Drop or Coalesce progressive display updates
+    int progressiveEdgeInterval; // refresh rate divider for tiles far from the focus
 
     // raytracing
     int maxTraceDepth;
@@ -158,6 +162,15 @@ class RenderGlobals
 
     bool getUseRenderRegion() const { return useRenderRegion; }
 
+    // Render region in render view (bottom-up) pixel coordinates.
+    void setRenderRegion(const int left, const int bottom, const int right, const int top)
+    {
+        regionLeft = left;
+        regionBottom = bottom;
+        regionRight = right;
+        regionTop = top;
+    }
+
     void getRenderRegion(int& left, int& bottom, int& right, int& top) const
     {
         left = regionLeft;
@@ -167,7 +180,10 @@ class RenderGlobals
     }
 
     bool detectShapeDeform;
+    bool deduplicateMeshes;     // share one mesh between shapes with identical geometry
+    MStringArray velocitySources; // color sets or per vertex attributes holding mesh velocities, in search order
     bool exportSceneFile;
+    int exportMode;             // RenderOnly, ExportOnly, RenderAndExport
     MString exportSceneFileName;
 
     bool useSunLightConnection;
@@ -180,12 +196,64 @@ class RenderGlobals
     MString optimizedTexturePath;
     bool useOptimizedTextures;
 
+    // appleseed configuration, read once per render
+    int lightingEngine;
+    int pixelRenderer;
+    int samplingMode;
+    int tileOrdering;
+    int texCacheSize;
+    float adaptiveQuality;
+    bool enableDiagnostics;
+    int frameRendererPasses;
+    bool enableIbl;
+    bool enableDl;
+    bool nextEventEstimation;
+    bool enableCaustics;
+    int dlMode;
+    int directLightSamples;
+    int photonType;
+    float sppmAlpha;
+    float initialRadius;
+    int photonsPerPass;
+    int envPhotonsPerPass;
+    int lightPhotonsPerPass;
+    int maxPhotonsPerEstimate;
+    float maxRayIntensity;
+    float maxPathLength;
+    float rrMinPathLength;
+    float pathTracingMaxPathLength;
+    float pathTracingRrMinPathLength;
+    float photonTracingMaxPathLength;
+    float photonTracingRrMinPathLength;
+
+    // environment, updated again if the globals node changes during IPR
+    int environmentType;
+    int environmentSamples;
+    float environmentIntensity;
+    MColor environmentColor;
+    MColor gradientHorizon;
+    MColor gradientZenit;
+    float latlongHoShift;
+    float latlongVeShift;
+    int skyModel;
+    float groundAlbedo;
+    float horizonShift;
+    float luminanceMultiplier;
+    float saturationMultiplier;
+    float turbidity;
+    float turbidityMax;
+    float turbidityMin;
+    double sunTheta;
+    double sunPhi;
+
     RenderGlobals();
 
     void getMbSteps();
     bool isTransformStep();
     bool isDeformStep();
     void getImageName();
+    void getRenderSettings();
+    void getEnvironmentSettings();
 
   private:
     int     imgWidth;
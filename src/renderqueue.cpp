@@ -30,8 +30,9 @@
 #include "renderqueue.h"
 
 // appleseed-maya headers.
-#include "utilities/concurrentqueue.h"
+#include "utilities/attrtools.h"
 #include "utilities/logging.h"
+#include "utilities/phasetimer.h"
 #include "utilities/tools.h"
 #include "event.h"
 #include "mayascene.h"
@@ -41,8 +42,12 @@
 
 // appleseed.foundation headers.
 #include "foundation/platform/thread.h"
+#include "foundation/platform/timers.h"
+#include "foundation/platform/types.h"
+#include "foundation/utility/stopwatch.h"
 
 // Maya headers.
+#include <maya/MAnimControl.h>
 #include <maya/MDagPath.h>
 #include <maya/MDGMessage.h>
 #include <maya/MFnDagNode.h>
@@ -50,12 +55,16 @@
 #include <maya/MItDag.h>
 #include <maya/MNodeMessage.h>
 #include <maya/MRenderView.h>
+#include <maya/MTime.h>
 #include <maya/MTimerMessage.h>
 
+// Boost headers.
+#include "boost/atomic/atomic.hpp"
+
 // Standard headers.
 #include <algorithm>
 #include <cassert>
-#include <ctime>
+#include <cstring>
 #include <map>
 #include <vector>
 
@@ -64,13 +73,30 @@ namespace
     MCallbackId idleCallbackId = 0;
     MCallbackId nodeAddedCallbackId = 0;
     MCallbackId nodeRemovedCallbackId = 0;
-    clock_t renderStartTime = 0;
-    clock_t renderEndTime = 0;
-    size_t numPixelsDone;
-    size_t numPixelsTotal;
+    // Rendering progress, numPixelsDone is updated by the tile callbacks.
+    boost::atomic<size_t> numPixelsDone(0);
+    size_t numPixelsTotal = 0;
+    foundation::Stopwatch<foundation::DefaultWallclockTimer> renderStopwatch;
+    double renderingStartTime = 0.0;    // seconds since initRender()
+    double renderEndTime = 0.0;         // seconds since initRender()
+    double lastProgressTime = 0.0;      // seconds since initRender()
+    int lastProgressPercent = -1;
+
+    // Minimum time between two progress bar updates, in seconds.
+    const double ProgressUpdateInterval = 0.25;
+
+    // Capacity of the render event queue, large enough to hold one event
+    // per 16x16 tile of a 1K frame.
+    const size_t RenderEventQueueCapacity = 4096;
+
+    // Maximum time spent handling render events per timer tick, in seconds.
+    const double RenderEventTimeBudget = 0.05;
 
     boost::thread renderThread;
-    concurrent_queue<Event> renderEventQueue;
+    RenderEventQueue renderEventQueue(RenderEventQueueCapacity);
+
+    // Display updates drained from the queue during the current tick.
+    std::vector<Event> pendingUpdates;
 }
 
 namespace
@@ -85,41 +111,7 @@ namespace
         if (!MRenderView::doesRenderEditorExist())
             return;
 
-        if (getWorldPtr()->mRenderGlobals->getUseRenderRegion())
-        {
-            unsigned int xmin = xMin, ymin = yMin, xmax = xMax, ymax = yMax;
-            unsigned int left, right, bottom, top;
-            MRenderView::getRenderRegion(left, right, bottom, top);
-            if ((xMax < left) || (xMin > right) || (yMax < bottom) || (yMin > top))
-                return;
-            if ((xmin < left) || (ymin < bottom) || (xmax > right) || (ymax > top))
-            {
-                xmin = std::max(xmin, left);
-                xmax = std::min(xmax, right);
-                ymin = std::max(ymin, bottom);
-                ymax = std::min(ymax, top);
-                const unsigned int origWidth = xMax - xMin + 1;
-                const unsigned int origHeight = yMax - yMin + 1;
-                const unsigned int width = xmax - xmin + 1;
-                const unsigned int height = ymax - ymin + 1;
-                const unsigned int xStart = xmin - xMin;
-                const unsigned int yStart = ymin - yMin;
-                std::auto_ptr<RV_PIXEL> p = std::auto_ptr<RV_PIXEL>(new RV_PIXEL[width * height]);
-                for (unsigned int x = 0; x < width; x++)
-                {
-                    for (unsigned int y = 0; y < height; y++)
-                    {
-                        const unsigned int sourceIndex = (yStart + y) * origWidth + xStart + x;
-                        const unsigned int destIndex = y * width + x;
-                        p.get()[destIndex] = pixels[sourceIndex];
-                    }
-                }
-                MRenderView::updatePixels(xmin, xmax, ymin, ymax, p.get(), true);
-                MRenderView::refresh(xmin, xmax, ymin, ymax);
-                return;
-            }
-        }
-
+        // Tile callbacks already clipped the pixels to the render region.
         MRenderView::updatePixels(xMin, xMax, yMin, yMax, pixels, true);
         MRenderView::refresh(xMin, xMax, yMin, yMax);
     }
@@ -133,42 +125,202 @@ namespace
         if (!MRenderView::doesRenderEditorExist())
             return;
 
-        unsigned int xmin = xMin, ymin = yMin, xmax = xMax, ymax = yMax;
-        if (getWorldPtr()->mRenderGlobals->getUseRenderRegion())
-        {
-            unsigned int left, right, bottom, top;
-            MRenderView::getRenderRegion(left, right, bottom, top);
-            if (xMax < left || xMin > right || yMax < bottom || yMin > top)
-                return;
-            xmin = std::max(xmin, left);
-            ymin = std::max(ymin, bottom);
-            xmax = std::min(xmax, right);
-            ymax = std::min(ymax, top);
-        }
-
+        // Tile callbacks already clipped the tile to the render region.
         RV_PIXEL line[4];
         for (uint x = 0; x < 4; x++)
             line[x].r = line[x].g = line[x].b = line[x].a = 1.0f;
 
-        MRenderView::updatePixels(xmin, xmin + 3, ymin, ymin, line, true);
-        MRenderView::updatePixels(xmin, xmin + 3, ymax, ymax, line, true);
-        MRenderView::updatePixels(xmax - 3, xmax, ymin, ymin, line, true);
-        MRenderView::updatePixels(xmax - 3, xmax, ymax, ymax, line, true);
-        MRenderView::updatePixels(xmin, xmin, ymin, ymin + 3, line, true);
-        MRenderView::updatePixels(xmax, xmax, ymin, ymin + 3, line, true);
-        MRenderView::updatePixels(xmin, xmin, ymax - 3, ymax, line, true);
-        MRenderView::updatePixels(xmax, xmax, ymax - 3, ymax, line, true);
-        MRenderView::refresh(xmin, xmax, ymin, ymax);
+        MRenderView::updatePixels(xMin, xMin + 3, yMin, yMin, line, true);
+        MRenderView::updatePixels(xMin, xMin + 3, yMax, yMax, line, true);
+        MRenderView::updatePixels(xMax - 3, xMax, yMin, yMin, line, true);
+        MRenderView::updatePixels(xMax - 3, xMax, yMax, yMax, line, true);
+        MRenderView::updatePixels(xMin, xMin, yMin, yMin + 3, line, true);
+        MRenderView::updatePixels(xMax, xMax, yMin, yMin + 3, line, true);
+        MRenderView::updatePixels(xMin, xMin, yMax - 3, yMax, line, true);
+        MRenderView::updatePixels(xMax, xMax, yMax - 3, yMax, line, true);
+        MRenderView::refresh(xMin, xMax, yMin, yMax);
+    }
+
+    // A rectangle of the render view covered by one or more display updates.
+    struct DirtyRegion
+    {
+        unsigned int        xMin;
+        unsigned int        xMax;
+        unsigned int        yMin;
+        unsigned int        yMax;
+        std::vector<size_t> updates;    // indices into pendingUpdates
+    };
+
+    bool compareByRows(const DirtyRegion& lhs, const DirtyRegion& rhs)
+    {
+        if (lhs.yMin != rhs.yMin)
+            return lhs.yMin < rhs.yMin;
+        if (lhs.yMax != rhs.yMax)
+            return lhs.yMax < rhs.yMax;
+        return lhs.xMin < rhs.xMin;
+    }
+
+    bool compareByColumns(const DirtyRegion& lhs, const DirtyRegion& rhs)
+    {
+        if (lhs.xMin != rhs.xMin)
+            return lhs.xMin < rhs.xMin;
+        if (lhs.xMax != rhs.xMax)
+            return lhs.xMax < rhs.xMax;
+        return lhs.yMin < rhs.yMin;
+    }
+
+    bool compareByLastUpdate(const DirtyRegion& lhs, const DirtyRegion& rhs)
+    {
+        return lhs.updates.back() < rhs.updates.back();
+    }
+
+    // Merge regions spanning the same rows (horizontal) or the same columns
+    // (vertical) that overlap or touch. The union of two such regions is
+    // again a rectangle, so merged regions never contain holes.
+    void mergeDirtyRegions(std::vector<DirtyRegion>& regions, const bool horizontal)
+    {
+        std::sort(regions.begin(), regions.end(), horizontal ? compareByRows : compareByColumns);
+
+        std::vector<DirtyRegion> merged;
+        merged.reserve(regions.size());
+
+        for (size_t i = 0; i < regions.size(); ++i)
+        {
+            const DirtyRegion& region = regions[i];
+
+            if (!merged.empty())
+            {
+                DirtyRegion& last = merged.back();
+                const bool sameSpan = horizontal
+                    ? last.yMin == region.yMin && last.yMax == region.yMax
+                    : last.xMin == region.xMin && last.xMax == region.xMax;
+                const bool touching = horizontal
+                    ? region.xMin <= last.xMax + 1
+                    : region.yMin <= last.yMax + 1;
+
+                if (sameSpan && touching)
+                {
+                    last.xMax = std::max(last.xMax, region.xMax);
+                    last.yMax = std::max(last.yMax, region.yMax);
+                    last.updates.insert(last.updates.end(), region.updates.begin(), region.updates.end());
+                    std::sort(last.updates.begin(), last.updates.end());
+                    continue;
+                }
+            }
+
+            merged.push_back(region);
+        }
+
+        regions.swap(merged);
+    }
+
+    // Send the pending display updates to the render view, issuing a single
+    // update and refresh per merged dirty region. Once the stopwatch exceeds
+    // the time budget, the updates of the regions not drawn yet are kept for
+    // the next tick. At least one region is drawn, a budget of 0 draws all.
+    void flushPendingUpdates(
+        foundation::Stopwatch<foundation::DefaultWallclockTimer>&  stopwatch,
+        const double                                                timeBudget)
+    {
+        if (pendingUpdates.empty())
+            return;
+
+        // Updates queued before a full frame update are superseded by it.
+        const unsigned int width = static_cast<unsigned int>(getWorldPtr()->mRenderGlobals->getWidth());
+        const unsigned int height = static_cast<unsigned int>(getWorldPtr()->mRenderGlobals->getHeight());
+        size_t first = 0;
+        for (size_t i = pendingUpdates.size(); i-- > 0; )
+        {
+            const Event& e = pendingUpdates[i];
+            if (e.xMin == 0 && e.yMin == 0 && e.xMax + 1 >= static_cast<int>(width) && e.yMax + 1 >= static_cast<int>(height))
+            {
+                first = i;
+                break;
+            }
+        }
+
+        std::vector<DirtyRegion> regions;
+        regions.reserve(pendingUpdates.size() - first);
+
+        for (size_t i = first; i < pendingUpdates.size(); ++i)
+        {
+            const Event& e = pendingUpdates[i];
+            DirtyRegion region;
+            region.xMin = e.xMin;
+            region.xMax = e.xMax;
+            region.yMin = e.yMin;
+            region.yMax = e.yMax;
+            region.updates.push_back(i);
+            regions.push_back(region);
+        }
+
+        mergeDirtyRegions(regions, true);
+        mergeDirtyRegions(regions, false);
+
+        // Regions that still overlap are drawn in queue order.
+        std::sort(regions.begin(), regions.end(), compareByLastUpdate);
+
+        std::vector<RV_PIXEL> pixels;
+
+        size_t r = 0;
+        for (; r < regions.size(); ++r)
+        {
+            if (r > 0 && timeBudget > 0.0 && stopwatch.measure().get_seconds() > timeBudget)
+                break;
+
+            const DirtyRegion& region = regions[r];
+
+            if (region.updates.size() == 1)
+            {
+                const Event& e = pendingUpdates[region.updates[0]];
+                updateRenderView(e.xMin, e.xMax, e.yMin, e.yMax, e.pixels.get());
+                continue;
+            }
+
+            const unsigned int regionWidth = region.xMax - region.xMin + 1;
+            const unsigned int regionHeight = region.yMax - region.yMin + 1;
+            pixels.resize(regionWidth * regionHeight);
+
+            for (size_t u = 0; u < region.updates.size(); ++u)
+            {
+                const Event& e = pendingUpdates[region.updates[u]];
+                const unsigned int updateWidth = e.xMax - e.xMin + 1;
+                const unsigned int updateHeight = e.yMax - e.yMin + 1;
+                const unsigned int xOffset = e.xMin - region.xMin;
+                const unsigned int yOffset = e.yMin - region.yMin;
+                for (unsigned int y = 0; y < updateHeight; ++y)
+                {
+                    memcpy(
+                        &pixels[(yOffset + y) * regionWidth + xOffset],
+                        e.pixels.get() + y * updateWidth,
+                        updateWidth * sizeof(RV_PIXEL));
+                }
+            }
+
+            updateRenderView(region.xMin, region.xMax, region.yMin, region.yMax, &pixels[0]);
+        }
+
+        // Keep the updates of the remaining regions in queue order.
+        std::vector<size_t> remaining;
+        for (; r < regions.size(); ++r)
+            remaining.insert(remaining.end(), regions[r].updates.begin(), regions[r].updates.end());
+        std::sort(remaining.begin(), remaining.end());
+
+        std::vector<Event> kept(remaining.size());
+        for (size_t i = 0; i < remaining.size(); ++i)
+            kept[i].swap(pendingUpdates[remaining[i]]);
+
+        pendingUpdates.swap(kept);
     }
 
     MString getElapsedTimeString()
     {
-        float elapsedTime = static_cast<float>(renderEndTime - renderStartTime) / CLOCKS_PER_SEC;
+        double elapsedTime = renderEndTime;
         const int hours = static_cast<int>(elapsedTime / 3600);
         elapsedTime -= hours * 3600;
         const int minutes = static_cast<int>(elapsedTime / 60);
         elapsedTime -= minutes * 60;
-        const float seconds = elapsedTime;
+        const double seconds = elapsedTime;
 
         char hourStr[32], minStr[32], secStr[32];
         sprintf(hourStr, "%02d", hours);
@@ -185,13 +337,26 @@ namespace
         return MString("(appleseed)\\n") + frameString + "  " + timeString;
     }
 
+    void joinRenderThread()
+    {
+        // Render threads may be waiting for room in the event queue and the
+        // queue is only consumed from the main thread, so discard pending
+        // events while waiting.
+        if (!renderThread.joinable())
+            return;
+
+        while (!renderThread.timed_join(boost::posix_time::milliseconds(10)))
+            renderEventQueue.clear();
+        pendingUpdates.clear();
+    }
+
     void renderThreadMain()
     {
         getWorldPtr()->mRenderer->render();
 
         Event event;
         event.mType = Event::RENDERDONE;
-        renderEventQueue.push(event);
+        pushEvent(event);
     }
 
     void addNodeCallbacks()
@@ -265,6 +430,7 @@ namespace
 
     void doPreFrameJobs()
     {
+        ScopedPhaseTimer timer("preFrameJobs");
         MString result;
         MGlobal::executeCommand(getWorldPtr()->mRenderGlobals->preFrameScript, result, true);
     }
@@ -281,8 +447,16 @@ namespace
         float currentFrame = getWorldPtr()->mRenderGlobals->getFrameNumber();
         boost::shared_ptr<MayaScene> mayaScene = getWorldPtr()->mScene;
         Logging::progress(MString("\n========== doPrepareFrame ") + currentFrame + " ==============\n");
+        ScopedPhaseTimer timer("prepareFrame");
+
+        // Motion samples are evaluated through DG contexts, so only the frame itself has to be current.
+        if (MAnimControl::currentTime() != MTime(currentFrame, MTime::uiUnit()))
+            MGlobal::viewFrame(currentFrame);
 
-        mayaScene->parseScene(); // all lists are cleaned and refilled with the current scene content
+        {
+            ScopedPhaseTimer parseTimer("prepareFrame.parseScene");
+            mayaScene->parseScene(); // refill all lists with the current scene content, or only update what changed since the last frame
+        }
         std::vector<boost::shared_ptr<MayaObject> >::iterator oIt;
         for (oIt = mayaScene->camList.begin(); oIt != mayaScene->camList.end(); oIt++)
         {
@@ -307,64 +481,63 @@ namespace
             return;
         }
 
-        int numMbSteps = (int)getWorldPtr()->mRenderGlobals->mbElementList.size();
+        const int numMbSteps = (int)getWorldPtr()->mRenderGlobals->mbElementList.size();
 
-        for (int mbStepId = 0; mbStepId < numMbSteps; mbStepId++)
-        {
-            getWorldPtr()->mRenderGlobals->currentMbStep = mbStepId;
-            getWorldPtr()->mRenderGlobals->currentMbElement = getWorldPtr()->mRenderGlobals->mbElementList[mbStepId];
-            getWorldPtr()->mRenderGlobals->currentFrameNumber = (float)(currentFrame + getWorldPtr()->mRenderGlobals->mbElementList[mbStepId].time);
-            bool needView = true;
+        ScopedPhaseTimer sampleTimer("prepareFrame.motionSamples");
+        getWorldPtr()->mRenderGlobals->currentMbStep = numMbSteps - 1;
+        getWorldPtr()->mRenderGlobals->currentMbElement = getWorldPtr()->mRenderGlobals->mbElementList.back();
+        getWorldPtr()->mRenderGlobals->currentFrameNumber = currentFrame;
 
-            // we can have some mb time steps at the same time, e.g. for xform and deform, then we do not need to update the view
-            if (mbStepId > 0)
-            {
-                if (getWorldPtr()->mRenderGlobals->mbElementList[mbStepId].time == getWorldPtr()->mRenderGlobals->mbElementList[mbStepId - 1].time)
-                {
-                    needView = false;
-                }
-            }
-
-            if (needView)
-            {
-                Logging::debug(MString("doFrameJobs() viewFrame: ") + getWorldPtr()->mRenderGlobals->currentFrameNumber);
-                MGlobal::viewFrame(getWorldPtr()->mRenderGlobals->currentFrameNumber);
-            }
-
-            if (getWorldPtr()->mScene)
-                mayaScene->updateScene();
-            else
-                Logging::error(MString("no maya scene ptr."));
+        if (getWorldPtr()->mScene)
+            mayaScene->sampleScene(currentFrame);
+        else
+            Logging::error(MString("no maya scene ptr."));
 
-            Logging::info(MString("update scene done"));
-            getWorldPtr()->mRenderGlobals->currentMbStep++;
-        }
+        Logging::info(MString("update scene done"));
+    }
 
-        if (MGlobal::mayaState() != MGlobal::kBatch)
-            MGlobal::viewFrame(currentFrame);
+    MString getDurationString(const double seconds)
+    {
+        const int totalSeconds = static_cast<int>(seconds + 0.5);
+        char buffer[32];
+        sprintf(buffer, "%02d:%02d:%02d", totalSeconds / 3600, (totalSeconds / 60) % 60, totalSeconds % 60);
+        return buffer;
     }
 
-    void logRenderingProgress(const size_t pixelsDone, const size_t pixelsTotal)
+    // Update the progress bar at most every ProgressUpdateInterval seconds,
+    // and only if the integer percentage changed.
+    void updateRenderingProgress()
     {
-        const float percents = static_cast<float>(100 * pixelsDone) / pixelsTotal;
-        if (static_cast<int>(percents) % 5 == 0)
-        {
-            char buffer[16];
-            sprintf(buffer, "%3.2f", percents);
-            MString progressStr;
-            progressStr.format("^1s% done.", MString(buffer));
-            Logging::info(progressStr);
-            MGlobal::executePythonCommand(format("import appleseed_maya.initialize; appleseed_maya.initialize.theRenderer().updateProgressBar(^1s)", buffer));
-        }
+        const RenderProgress progress = getRenderProgress();
+        const int percent = static_cast<int>(progress.progress * 100.0f);
+
+        if (percent == lastProgressPercent)
+            return;
+
+        if (progress.elapsed - lastProgressTime < ProgressUpdateInterval && percent < 100)
+            return;
+
+        lastProgressTime = progress.elapsed;
+        lastProgressPercent = percent;
+
+        MString progressStr = format("^1s% done", percent);
+        if (progress.remaining >= 0.0)
+            progressStr += MString(", ") + getDurationString(progress.remaining) + " remaining";
+        Logging::info(progressStr + ".");
+
+        MGlobal::executePythonCommand(
+            format("import appleseed_maya.initialize; appleseed_maya.initialize.theRenderer().updateProgressBar(^1s)", progress.progress));
     }
 }
 
 void initRender(const World::RenderType renderType, const int width, const int height, const MDagPath cameraDagPath, const bool doRenderRegion)
 {
-    renderStartTime = clock();
+    renderStopwatch.start();
     getWorldPtr()->setRenderType(renderType);
+    clearAttributeCache();
 
-    // Here we create the overall scene, renderer and renderGlobals objects
+    // Here we create the overall scene, renderer and renderGlobals objects, the
+    // renderGlobals take a snapshot of the render settings for the whole render
     getWorldPtr()->initializeRenderEnvironment();
     getWorldPtr()->mRenderGlobals->setResolution(width, height);
     getWorldPtr()->mRenderGlobals->setUseRenderRegion(doRenderRegion);
@@ -378,8 +551,10 @@ void initRender(const World::RenderType renderType, const int width, const int h
 
         if (getWorldPtr()->mRenderGlobals->getUseRenderRegion())
         {
+            // Capture the render region once, tile callbacks clip against it.
             unsigned int left, right, bottom, top;
             MRenderView::getRenderRegion(left, right, bottom, top);
+            getWorldPtr()->mRenderGlobals->setRenderRegion(left, bottom, right, top);
 #if MAYA_API_VERSION >= 201600
             MRenderView::startRegionRender(width, height, left, right, bottom, top, true, true);
 #else
@@ -410,8 +585,25 @@ void initRender(const World::RenderType renderType, const int width, const int h
         }
     }
 
+    // Progress is counted in rendered pixels, over all passes.
+    int displayWidth = width, displayHeight = height;
+    if (getWorldPtr()->mRenderGlobals->getUseRenderRegion())
+    {
+        int left, bottom, right, top;
+        getWorldPtr()->mRenderGlobals->getRenderRegion(left, bottom, right, top);
+        displayWidth = right - left + 1;
+        displayHeight = top - bottom + 1;
+    }
+    const int passes = getWorldPtr()->mRenderGlobals->frameRendererPasses;
     numPixelsDone = 0;
-    numPixelsTotal = width * height;
+    numPixelsTotal = static_cast<size_t>(displayWidth) * displayHeight * std::max(passes, 1);
+    renderingStartTime = 0.0;
+    lastProgressTime = 0.0;
+    lastProgressPercent = -1;
+
+    renderEventQueue.setPolicy(
+        static_cast<RenderEventQueue::BackpressurePolicy>(getWorldPtr()->mRenderGlobals->displayQueuePolicy));
+    renderEventQueue.resetStats();
 
     if (getWorldPtr()->getRenderType() != World::IPRRENDER)
     {
@@ -425,6 +617,7 @@ void initRender(const World::RenderType renderType, const int width, const int h
     if (MGlobal::mayaState() != MGlobal::kBatch)
     {
         getWorldPtr()->mRenderGlobals->updateFrameNumber();
+        PhaseTimings::clear();
         doPreFrameJobs(); // preRenderScript etc.
         doPrepareFrame(); // parse scene and update objects
         getWorldPtr()->mRenderer->preFrame();
@@ -434,34 +627,42 @@ void initRender(const World::RenderType renderType, const int width, const int h
     }
     else
     {
+        // Keep the scene across frames and only re-parse what changes between them.
+        getWorldPtr()->mScene->startChangeTracking();
+
         while (!getWorldPtr()->mRenderGlobals->frameListDone())
         {
             getWorldPtr()->mRenderGlobals->updateFrameNumber();
+            PhaseTimings::clear();
             doPreFrameJobs(); // preRenderScript etc.
             doPrepareFrame(); // parse scene and update objects
             getWorldPtr()->mRenderer->preFrame();
             getWorldPtr()->mRenderer->render(); // render blocking
             doPostFrameJobs();
+            PhaseTimings::log(getWorldPtr()->mRenderGlobals->getFrameNumber());
         }
 
+        getWorldPtr()->mScene->stopChangeTracking();
+
         waitUntilRenderFinishes();
     }
 }
 
 void startRendering()
 {
+    renderingStartTime = renderStopwatch.measure().get_seconds();
     renderThread = boost::thread(renderThreadMain);
 }
 
 void stopRendering()
 {
     getWorldPtr()->mRenderer->abortRendering();
-    renderThread.join();
+    joinRenderThread();
 }
 
 void waitUntilRenderFinishes()
 {
-    renderThread.join();
+    joinRenderThread();
 
     if (MGlobal::mayaState() != MGlobal::kBatch)
     {
@@ -477,18 +678,32 @@ void waitUntilRenderFinishes()
         removeNodeCallbacks();
 
     getWorldPtr()->setRenderState(World::RSTATEDONE);
-    renderEndTime = clock();
+    renderEndTime = renderStopwatch.measure().get_seconds();
+
+    // Batch renders log the timings after each frame.
+    if (MGlobal::mayaState() != MGlobal::kBatch)
+        PhaseTimings::log(getWorldPtr()->mRenderGlobals->getFrameNumber());
 
     if (MRenderView::doesRenderEditorExist())
     {
         MGlobal::executePythonCommandOnIdle(
             MString("import pymel.core as pm; pm.renderWindowEditor(\"renderView\", edit=True, pcaption=\"") + getCaptionString() + "\");");
 
-        // Empty the queue.
-        Event e;
-        while (renderEventQueue.try_pop(e)) {}
+        renderEventQueue.clear();
     }
 
+    const RenderEventQueue::Stats stats = renderEventQueue.getStats();
+    Logging::debug(
+        MString("Render event queue: ") +
+        static_cast<int>(stats.pushed) + " pushed, " +
+        static_cast<int>(stats.popped) + " popped, " +
+        static_cast<int>(stats.dropped) + " dropped, " +
+        static_cast<int>(stats.coalesced) + " coalesced, " +
+        static_cast<int>(stats.contended) + " contended, " +
+        static_cast<int>(stats.blocked) + " blocked, high water " +
+        static_cast<int>(stats.highWater) + " of " +
+        static_cast<int>(stats.capacity) + ".");
+
     getWorldPtr()->cleanUpAfterRender();
     getWorldPtr()->mRenderer->unInitializeRenderer();
     getWorldPtr()->setRenderState(World::RSTATENONE);
@@ -501,47 +716,101 @@ void iprUpdateRenderRegion()
 
     unsigned int left, right, bottom, top;
     MRenderView::getRenderRegion(left, right, bottom, top);
-    const foundation::AABB2u crop(
-        foundation::AABB2u::VectorType(left, bottom),
-        foundation::AABB2u::VectorType(right, top));
-    getWorldPtr()->mRenderer->getProjectPtr()->get_frame()->set_crop_window(crop);
+    getWorldPtr()->mRenderGlobals->setRenderRegion(left, bottom, right, top);
+    getWorldPtr()->mRenderGlobals->setUseRenderRegion(true);
+    getWorldPtr()->mRenderer->updateRenderRegion();
 
     startRendering();
 }
 
-void pushEvent(const Event& e)
+bool pushEvent(Event& e, const bool droppable)
 {
-    renderEventQueue.push(e);
+    // In batch mode nothing consumes the queue.
+    if (MGlobal::mayaState() == MGlobal::kBatch)
+        return false;
+
+    // Tiles are identified by their origin.
+    const foundation::uint64 key =
+        (static_cast<foundation::uint64>(e.mType) << 56) |
+        (static_cast<foundation::uint64>(e.xMin & 0xFFFFFFF) << 28) |
+        static_cast<foundation::uint64>(e.yMin & 0xFFFFFFF);
+
+    return renderEventQueue.push(e, droppable, key);
+}
+
+void addRenderedPixels(const size_t count)
+{
+    numPixelsDone.fetch_add(count, boost::memory_order_relaxed);
+}
+
+RenderProgress getRenderProgress()
+{
+    RenderProgress progress;
+    progress.elapsed = renderStopwatch.measure().get_seconds();
+    progress.progress =
+        numPixelsTotal > 0
+            ? std::min(static_cast<float>(numPixelsDone.load(boost::memory_order_relaxed)) / numPixelsTotal, 1.0f)
+            : 0.0f;
+
+    // Extrapolate from the time spent rendering so far, scene translation excluded.
+    const double renderingTime = progress.elapsed - renderingStartTime;
+    progress.remaining =
+        progress.progress > 0.0f && renderingStartTime > 0.0
+            ? renderingTime * (1.0 - progress.progress) / progress.progress
+            : -1.0;
+
+    return progress;
+}
+
+const RenderEventQueue& getRenderEventQueue()
+{
+    return renderEventQueue;
 }
 
 void renderQueueWorkerCallback(float time, float lastTime, void* userPtr)
 {
+    // Drain as many events as the time budget allows; display updates are
+    // collected and sent to the render view at the end of the tick, within
+    // the same budget. Updates left over are drawn during the next ticks.
+    foundation::Stopwatch<foundation::DefaultWallclockTimer> stopwatch;
+    stopwatch.start();
+
+    bool renderDone = false;
     Event e;
-    if (!renderEventQueue.try_pop(e))
-        return;
 
-    switch (e.mType)
+    // Leave events in the queue while the display is behind, so that the
+    // queue fills up and its backpressure policy applies.
+    while (!renderDone && pendingUpdates.size() < RenderEventQueueCapacity && renderEventQueue.tryPop(e))
     {
-      case Event::RENDERDONE:
+        switch (e.mType)
         {
-            if (getWorldPtr()->getRenderType() != World::IPRRENDER)
-                waitUntilRenderFinishes();
-        }
-        break;
+          case Event::RENDERDONE:
+            renderDone = true;
+            break;
 
-      case Event::UPDATEUI:
-        {
-            updateRenderView(e.xMin, e.xMax, e.yMin, e.yMax, e.pixels.get());
-            numPixelsDone += (e.xMax - e.xMin) * (e.yMax - e.yMin);
-            if (getWorldPtr()->getRenderType() != World::IPRRENDER)
-                logRenderingProgress(numPixelsDone, numPixelsTotal);
-        }
-        break;
+          case Event::UPDATEUI:
+            {
+                pendingUpdates.push_back(Event());
+                pendingUpdates.back().swap(e);
+            }
+            break;
 
-      case Event::PRETILE:
-        {
+          case Event::PRETILE:
             preTileRenderView(e.xMin, e.xMax, e.yMin, e.yMax);
+            break;
         }
-        break;
+
+        if (stopwatch.measure().get_seconds() > RenderEventTimeBudget)
+            break;
     }
+
+    // The final image is drawn completely.
+    flushPendingUpdates(stopwatch, renderDone ? 0.0 : RenderEventTimeBudget);
+
+    if (getWorldPtr()->getRenderType() != World::IPRRENDER &&
+        getWorldPtr()->getRenderState() == World::RSTATERENDERING)
+        updateRenderingProgress();
+
+    if (renderDone && getWorldPtr()->getRenderType() != World::IPRRENDER)
+        waitUntilRenderFinishes();
 }
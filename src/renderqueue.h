@@ -30,13 +30,24 @@
 #define RENDERQUEUE_H
 
 // appleseed-maya headers.
+#include "utilities/mpscringbuffer.h"
 #include "world.h"
 
+// Standard headers.
+#include <cstddef>
+
 // Forward declarations.
 class Event;
 class MDagPath;
 
-void pushEvent(const Event& e);
+typedef MPSCRingBuffer<Event> RenderEventQueue;
+
+// Swaps the event into the render event queue, leaving it default constructed.
+// Droppable events may be discarded or coalesced when the queue is full,
+// depending on the displayQueuePolicy render setting. A coalesced event only
+// replaces a pending event of the same type for the same tile.
+// Returns false if the event was not queued.
+bool pushEvent(Event& e, const bool droppable = false);
 void renderQueueWorkerCallback(float time, float lastTime, void* userPtr);
 
 void initRender(
@@ -52,4 +63,19 @@ void stopRendering();
 void startRendering();
 void waitUntilRenderFinishes();
 
+// Called by the tile callbacks when pixels have been rendered.
+void addRenderedPixels(const size_t count);
+
+struct RenderProgress
+{
+    float   progress;       // fraction of the pixels rendered, in [0, 1]
+    double  elapsed;        // seconds since the render was started
+    double  remaining;      // estimated seconds left, or -1 if unknown
+};
+
+RenderProgress getRenderProgress();
+
+// Gives access to the contention counters of the render event queue.
+const RenderEventQueue& getRenderEventQueue();
+
 #endif  // !RENDERQUEUE_H
@@ -30,6 +30,8 @@
 #include "tilecallback.h"
 
 // appleseed-maya headers.
+#include "utilities/pixelconversion.h"
+#include "displaybufferpool.h"
 #include "event.h"
 #include "renderglobals.h"
 #include "renderqueue.h"
@@ -44,10 +46,76 @@
 #include "foundation/image/image.h"
 #include "foundation/image/pixel.h"
 #include "foundation/image/tile.h"
-#include "foundation/math/scalar.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+
+namespace
+{
+    // Clip a rectangle given in render view coordinates against the crop
+    // window. Returns false if nothing is left.
+    bool clipToCrop(
+        const foundation::AABB2u&   crop,
+        size_t&                     xMin,
+        size_t&                     yMin,
+        size_t&                     xMax,
+        size_t&                     yMax)
+    {
+        if (!crop.is_valid())
+            return true;
+
+        xMin = std::max<size_t>(xMin, crop.min.x);
+        yMin = std::max<size_t>(yMin, crop.min.y);
+        xMax = std::min<size_t>(xMax, crop.max.x);
+        yMax = std::min<size_t>(yMax, crop.max.y);
+
+        return xMin <= xMax && yMin <= yMax;
+    }
+
+    // Compute the bounds of a tile in render view coordinates, clipped to the
+    // crop window. Returns false if the tile is not displayed at all.
+    bool getDisplayBounds(
+        const foundation::CanvasProperties& frameProps,
+        const foundation::AABB2u&           crop,
+        const size_t                        tile_x,
+        const size_t                        tile_y,
+        size_t&                             xMin,
+        size_t&                             yMin,
+        size_t&                             xMax,
+        size_t&                             yMax)
+    {
+        const size_t x = tile_x * frameProps.m_tile_width;
+        const size_t y = tile_y * frameProps.m_tile_height;
+        const size_t tileWidth = std::min(frameProps.m_tile_width, frameProps.m_canvas_width - x);
+        const size_t tileHeight = std::min(frameProps.m_tile_height, frameProps.m_canvas_height - y);
+
+        xMin = x;
+        xMax = x + tileWidth - 1;
+        yMin = frameProps.m_canvas_height - y - tileHeight;
+        yMax = frameProps.m_canvas_height - y - 1;
+
+        return clipToCrop(crop, xMin, yMin, xMax, yMax);
+    }
+
+    // Render view pixels are converted in place as RGBA floats.
+    float* asFloats(RV_PIXEL* pixels)
+    {
+        assert(sizeof(RV_PIXEL) == 4 * sizeof(float));
+        return reinterpret_cast<float*>(pixels);
+    }
+}
+
+TileCallback::TileCallback(
+    const boost::shared_ptr<DisplayBufferPool>& bufferPool,
+    const foundation::AABB2u&                   crop)
+  : mBufferPool(bufferPool)
+  , mCrop(crop)
+  , mTileCount(0)
+  , mPassCount(0)
+{
+}
 
 void TileCallback::release()
 {
@@ -60,33 +128,35 @@ void TileCallback::pre_render(
     const size_t            width,
     const size_t            height)
 {
-    Event e;
     boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
-    const int frameHeight = renderGlobals->getHeight();
-    e.pixels = boost::shared_ptr<RV_PIXEL>(new RV_PIXEL[width * height]);
-    RV_PIXEL* pixelsPtr = e.pixels.get();
-    memset(pixelsPtr, 0, width * height * sizeof(RV_PIXEL));
-    e.xMin = static_cast<unsigned int>(x);
-    e.xMax = static_cast<unsigned int>(x + width - 1);
-    e.yMin = static_cast<unsigned int>(frameHeight - y - height);
-    e.yMax = static_cast<unsigned int>(frameHeight - y - 1);
+    const size_t frameHeight = static_cast<size_t>(renderGlobals->getHeight());
+
+    size_t xMin = x;
+    size_t xMax = x + width - 1;
+    size_t yMin = frameHeight - y - height;
+    size_t yMax = frameHeight - y - 1;
+    if (!clipToCrop(mCrop, xMin, yMin, xMax, yMax))
+        return;
+
+    Event e;
+    e.xMin = static_cast<unsigned int>(xMin);
+    e.xMax = static_cast<unsigned int>(xMax);
+    e.yMin = static_cast<unsigned int>(yMin);
+    e.yMax = static_cast<unsigned int>(yMax);
     e.mType = Event::PRETILE;
-    pushEvent(e);
+
+    // Tile markers are purely cosmetic.
+    pushEvent(e, true);
 }
 
 void TileCallback::post_render(const renderer::Frame* frame)
 {
     const foundation::CanvasProperties& frameProps = frame->image().properties();
-    Event e;
-    e.pixels = boost::shared_ptr<RV_PIXEL>(new RV_PIXEL[frameProps.m_pixel_count]);
-    RV_PIXEL* pixelsPtr = e.pixels.get();
 
-    for (size_t i = 0; i < frameProps.m_pixel_count; i++)
+    if (mTileCount != frameProps.m_tile_count)
     {
-        pixelsPtr[i].r = 0.0f;
-        pixelsPtr[i].g = 0.0f;
-        pixelsPtr[i].b = 0.0f;
-        pixelsPtr[i].a = 0.0f;
+        mTileCount = frameProps.m_tile_count;
+        mPassCount = 0;
     }
 
     foundation::Tile float_tile_storage(
@@ -99,84 +169,131 @@ void TileCallback::post_render(const renderer::Frame* frame)
     {
         for (size_t tile_x = 0; tile_x < frameProps.m_tile_count_x; tile_x++)
         {
-            const foundation::Tile& tile = frame->image().tile(tile_x, tile_y);
-            const size_t tileWidth = tile.get_width();
-            const size_t tileHeight = tile.get_height();
-
-            // Tile with the right pixel format in the right color space.
-            foundation::Tile finalTile(
-                tile,
-                foundation::PixelFormatFloat,
-                float_tile_storage.get_storage());
-            frame->transform_to_output_color_space(finalTile);
-
-            for (size_t y = 0; y < tileHeight; y++)
-            {
-                for (size_t x = 0; x < tileWidth; x++)
-                {
-                    const size_t pixelIndex =
-                        frameProps.m_canvas_width * (frameProps.m_canvas_height - tile_y * frameProps.m_tile_height - y - 1) +
-                        tile_x * frameProps.m_tile_width +
-                        x;
-                    assert(pixelIndex < frameProps.m_pixel_count);
-
-                    const float* source = reinterpret_cast<const float*>(finalTile.pixel(x, y));
-                    pixelsPtr[pixelIndex].r = foundation::saturate(source[0]);
-                    pixelsPtr[pixelIndex].g = foundation::saturate(source[1]);
-                    pixelsPtr[pixelIndex].b = foundation::saturate(source[2]);
-                    pixelsPtr[pixelIndex].a = foundation::saturate(source[3]);
-                }
-            }
+            if (!isTileDue(frame, tile_x, tile_y))
+                continue;
+
+            // A newer pass supersedes this one, so progressive tiles may be
+            // dropped or coalesced per tile when the display falls behind.
+            pushTile(frame, tile_x, tile_y, float_tile_storage.get_storage(), true);
         }
     }
 
-    e.xMin = 0;
-    e.xMax = static_cast<unsigned int>(frameProps.m_canvas_width - 1);
-    e.yMin = 0;
-    e.yMax = static_cast<unsigned int>(frameProps.m_canvas_height - 1);
-    e.mType = Event::UPDATEUI;
-    pushEvent(e);
+    ++mPassCount;
+}
+
+void TileCallback::pushFrame(const renderer::Frame* frame)
+{
+    const foundation::CanvasProperties& frameProps = frame->image().properties();
+
+    foundation::Tile float_tile_storage(
+        frameProps.m_tile_width,
+        frameProps.m_tile_height,
+        frameProps.m_channel_count,
+        foundation::PixelFormatFloat);
+
+    for (size_t tile_y = 0; tile_y < frameProps.m_tile_count_y; tile_y++)
+    {
+        for (size_t tile_x = 0; tile_x < frameProps.m_tile_count_x; tile_x++)
+            pushTile(frame, tile_x, tile_y, float_tile_storage.get_storage(), false);
+    }
 }
 
 void TileCallback::post_render_tile(
     const renderer::Frame*  frame,
     const size_t            tile_x,
     const size_t            tile_y)
+{
+    addRenderedPixels(pushTile(frame, tile_x, tile_y, 0, false));
+}
+
+bool TileCallback::isTileDue(
+    const renderer::Frame*  frame,
+    const size_t            tile_x,
+    const size_t            tile_y) const
+{
+    const boost::shared_ptr<RenderGlobals> renderGlobals = getWorldPtr()->mRenderGlobals;
+    const int maxInterval = renderGlobals->progressiveEdgeInterval;
+    if (maxInterval <= 1 || mPassCount == 0)
+        return true;
+
+    const foundation::CanvasProperties& frameProps = frame->image().properties();
+    const float width = static_cast<float>(frameProps.m_canvas_width);
+    const float height = static_cast<float>(frameProps.m_canvas_height);
+
+    // Focus on the center of the render region, or of the frame.
+    // Render region coordinates are bottom-up, tiles are top-down.
+    float focusX = 0.5f * width;
+    float focusY = 0.5f * height;
+    if (mCrop.is_valid())
+    {
+        focusX = 0.5f * (mCrop.min.x + mCrop.max.x);
+        focusY = height - 0.5f * (mCrop.min.y + mCrop.max.y);
+    }
+
+    const float maxDx = std::max(focusX, width - focusX);
+    const float maxDy = std::max(focusY, height - focusY);
+    const float maxDistance = std::sqrt(maxDx * maxDx + maxDy * maxDy);
+
+    const float dx = (tile_x + 0.5f) * frameProps.m_tile_width - focusX;
+    const float dy = (tile_y + 0.5f) * frameProps.m_tile_height - focusY;
+    const float distance = std::min(std::sqrt(dx * dx + dy * dy) / maxDistance, 1.0f);
+
+    // Tiles far from the focus are only refreshed every few passes, staggered
+    // so that the work is spread over the passes.
+    const size_t interval = 1 + static_cast<size_t>(distance * (maxInterval - 1));
+    const size_t tileIndex = tile_y * frameProps.m_tile_count_x + tile_x;
+    return (mPassCount + tileIndex) % interval == 0;
+}
+
+size_t TileCallback::pushTile(
+    const renderer::Frame*  frame,
+    const size_t            tile_x,
+    const size_t            tile_y,
+    foundation::uint8*      storage,
+    const bool              droppable)
 {
     const foundation::Image& image = frame->image();
     const foundation::CanvasProperties& frameProps = image.properties();
     const foundation::Tile& tile = image.tile(tile_x, tile_y);
-    const size_t tileWidth = tile.get_width();
-    const size_t tileHeight = tile.get_height();
+
+    size_t xMin, yMin, xMax, yMax;
+    if (!getDisplayBounds(frameProps, mCrop, tile_x, tile_y, xMin, yMin, xMax, yMax))
+        return 0;
+
     Event e;
     // Tile with the right pixel format in the right color space.
-    foundation::Tile finalTile(tile, foundation::PixelFormatFloat);
+    foundation::Tile finalTile(tile, foundation::PixelFormatFloat, storage);
     frame->transform_to_output_color_space(finalTile);
-    e.pixels = boost::shared_ptr<RV_PIXEL>(new RV_PIXEL[tileWidth * tileHeight]);
-    RV_PIXEL* pixelsPtr = e.pixels.get();
-
-    for (size_t y = 0; y < tileHeight; y++)
-    {
-        for (size_t x = 0; x < tileWidth; x++)
-        {
-            const float* source = reinterpret_cast<const float*>(finalTile.pixel(x, tileHeight - y - 1));
-            const size_t pixelIndex = y * tileWidth + x;
-            pixelsPtr[pixelIndex].r = foundation::saturate(source[0]);
-            pixelsPtr[pixelIndex].g = foundation::saturate(source[1]);
-            pixelsPtr[pixelIndex].b = foundation::saturate(source[2]);
-            pixelsPtr[pixelIndex].a = foundation::saturate(source[3]);
-        }
-    }
+    e.pixels = mBufferPool->acquireTile(frameProps);
 
-    const size_t x = tile_x * frameProps.m_tile_width;
-    const size_t y = tile_y * frameProps.m_tile_height;
+    // The top row of the clipped rectangle is the first tile row to convert.
+    const size_t width = xMax - xMin + 1;
+    const size_t height = yMax - yMin + 1;
+    convertTileToDisplay(
+        finalTile,
+        xMin - tile_x * frameProps.m_tile_width,
+        frameProps.m_canvas_height - tile_y * frameProps.m_tile_height - 1 - yMax,
+        width,
+        height,
+        asFloats(e.pixels.get()),
+        width * 4,
+        true);
 
-    e.xMin = static_cast<unsigned int>(x);
-    e.xMax = static_cast<unsigned int>(x + tileWidth - 1);
-    e.yMin = static_cast<unsigned int>(frameProps.m_canvas_height - y - tileHeight);
-    e.yMax = static_cast<unsigned int>(frameProps.m_canvas_height - y - 1);
+    e.xMin = static_cast<unsigned int>(xMin);
+    e.xMax = static_cast<unsigned int>(xMax);
+    e.yMin = static_cast<unsigned int>(yMin);
+    e.yMax = static_cast<unsigned int>(yMax);
     e.mType = Event::UPDATEUI;
-    pushEvent(e);
+    if (!pushEvent(e, droppable))
+        return 0;
+
+    return width * height;
+}
+
+TileCallbackFactory::TileCallbackFactory(const foundation::AABB2u& crop)
+  : mCrop(crop)
+  , mBufferPool(new DisplayBufferPool())
+{
 }
 
 void TileCallbackFactory::release()
@@ -186,5 +303,15 @@ void TileCallbackFactory::release()
 
 renderer::ITileCallback* TileCallbackFactory::create()
 {
-    return new TileCallback();
+    return new TileCallback(mBufferPool, mCrop);
+}
+
+void TileCallbackFactory::pushFrame(const renderer::Frame* frame)
+{
+    TileCallback(mBufferPool, mCrop).pushFrame(frame);
+}
+
+void TileCallbackFactory::setCrop(const foundation::AABB2u& crop)
+{
+    mCrop = crop;
 }
@@ -33,7 +33,12 @@
 #include "renderer/api/rendering.h"
 
 // appleseed.foundation headers.
+#include "foundation/math/aabb.h"
 #include "foundation/platform/compiler.h"
+#include "foundation/platform/types.h"
+
+// Boost headers.
+#include "boost/shared_ptr.hpp"
 
 // Standard headers.
 #include <cstddef>
@@ -41,11 +46,18 @@
 // Forward declarations.
 namespace foundation    { class Tile; }
 namespace renderer      { class Frame; }
+class DisplayBufferPool;
 
 class TileCallback
   : public renderer::ITileCallback
 {
   public:
+    // crop is the render region in render view coordinates, or an invalid
+    // box to display the whole frame. It is owned by the factory.
+    TileCallback(
+        const boost::shared_ptr<DisplayBufferPool>& bufferPool,
+        const foundation::AABB2u&                   crop);
+
     // Delete this instance.
     virtual void release() APPLESEED_OVERRIDE;
 
@@ -57,6 +69,10 @@ class TileCallback
         const size_t            height) APPLESEED_OVERRIDE;
 
     // This method is called after a whole frame is rendered (at once).
+    // Tiles far from the focus are only sent every few calls, depending on
+    // the progressiveEdgeInterval render setting, and the tiles may be dropped
+    // when the render view falls behind. pushFrame() has to be called once
+    // rendering stopped.
     virtual void post_render(
         const renderer::Frame*  frame) APPLESEED_OVERRIDE;
 
@@ -64,16 +80,59 @@ class TileCallback
         const renderer::Frame*  frame,
         const size_t            tile_x,
         const size_t            tile_y) APPLESEED_OVERRIDE;
+
+    // Send every tile of the frame to the render view. None of them is dropped.
+    void pushFrame(const renderer::Frame* frame);
+
+  private:
+    boost::shared_ptr<DisplayBufferPool> mBufferPool;
+    const foundation::AABB2u&            mCrop;
+
+    // Progressive display state: tile count of the current frame and the
+    // number of post_render() calls since it changed.
+    size_t                               mTileCount;
+    size_t                               mPassCount;
+
+    bool isTileDue(
+        const renderer::Frame*  frame,
+        const size_t            tile_x,
+        const size_t            tile_y) const;
+
+    // Returns the number of pixels sent to the render view.
+    size_t pushTile(
+        const renderer::Frame*  frame,
+        const size_t            tile_x,
+        const size_t            tile_y,
+        foundation::uint8*      storage,
+        const bool              droppable);
 };
 
 class TileCallbackFactory
   : public renderer::ITileCallbackFactory
 {
   public:
+    // crop is the render region in render view (bottom-up) coordinates.
+    // Tile callbacks only convert and display pixels inside of it.
+    // An invalid box means the whole frame.
+    explicit TileCallbackFactory(const foundation::AABB2u& crop);
+
     // Delete this instance.
     virtual void release() APPLESEED_OVERRIDE;
 
     virtual renderer::ITileCallback* create() APPLESEED_OVERRIDE;
+
+    // Send the whole frame to the render view, e.g. after a progressive render
+    // stopped, so that it shows the final pixels of every tile.
+    void pushFrame(const renderer::Frame* frame);
+
+    // Must not be called while rendering.
+    void setCrop(const foundation::AABB2u& crop);
+
+  private:
+    foundation::AABB2u mCrop;
+
+    // Shared by all tile callbacks so that buffers are recycled across render threads.
+    boost::shared_ptr<DisplayBufferPool> mBufferPool;
 };
 
 #endif  // !TILECALLBACK_H
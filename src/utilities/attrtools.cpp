@@ -41,6 +41,99 @@
 #include <maya/MMatrix.h>
 #include <maya/MFnMatrixData.h>
 #include <maya/MAngle.h>
+#include <maya/MMessage.h>
+#include <maya/MSceneMessage.h>
+#include <maya/MStringArray.h>
+
+// Boost headers.
+#include "boost/thread/thread.hpp"
+
+// Standard headers.
+#include <cassert>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace
+{
+    // Attribute handles of all nodes of one type, by attribute name. Only used from the main thread.
+    typedef std::map<std::pair<unsigned int, std::string>, MObject> AttributeCache;
+    AttributeCache attributeCache;
+
+    boost::thread::id mainThreadId;
+    MCallbackId pluginUnloadCallbackId = 0;
+
+    void pluginUnloadCallback(const MStringArray& strs, void* clientData)
+    {
+        clearAttributeCache();
+    }
+}
+
+MObject findAttribute(const MFnDependencyNode& dn, const char* attrName)
+{
+    assert(mainThreadId == boost::thread::id() || boost::this_thread::get_id() == mainThreadId);
+
+    const AttributeCache::key_type key(dn.typeId().id(), attrName);
+    const AttributeCache::const_iterator i = attributeCache.find(key);
+    if (i != attributeCache.end())
+        return i->second;
+
+    MStatus stat;
+    const MObject attr = dn.attribute(attrName, &stat);
+    if (!stat)
+        return MObject();
+
+    // Dynamic attributes only exist on a single node, they cannot be shared with the other nodes of the type.
+    if (dn.attributeClass(attr) != MFnDependencyNode::kLocalDynamicAttr)
+        attributeCache.insert(std::make_pair(key, attr));
+
+    return attr;
+}
+
+MPlug findCachedPlug(const MFnDependencyNode& dn, const char* attrName, MStatus* status)
+{
+    const MObject attr = findAttribute(dn, attrName);
+    if (attr.isNull())
+    {
+        if (status)
+            *status = MS::kInvalidParameter;
+        return MPlug();
+    }
+
+    if (status)
+        *status = MS::kSuccess;
+    return MPlug(dn.object(), attr);
+}
+
+void clearAttributeCache()
+{
+    attributeCache.clear();
+}
+
+MStatus initializeAttributeCache()
+{
+    mainThreadId = boost::this_thread::get_id();
+
+    MStatus status;
+    pluginUnloadCallbackId =
+        MSceneMessage::addStringArrayCallback(
+            MSceneMessage::kBeforePluginUnload,
+            pluginUnloadCallback,
+            0,
+            &status);
+    return status;
+}
+
+void uninitializeAttributeCache()
+{
+    if (pluginUnloadCallbackId != 0)
+    {
+        MMessage::removeCallback(pluginUnloadCallbackId);
+        pluginUnloadCallbackId = 0;
+    }
+
+    clearAttributeCache();
+}
 
 double getDegrees(const char* plugName, const MFnDependencyNode& dn)
 {
@@ -52,14 +145,14 @@ double getDegrees(const char* plugName, const MFnDependencyNode& dn)
 float getFloatAttr(const char* plugName, const MFnDependencyNode& dn, const float defaultValue)
 {
     MStatus status = MS::kSuccess;
-    const MPlug plug = dn.findPlug(plugName, &status);
+    const MPlug plug = findCachedPlug(dn, plugName, &status);
     return status == MStatus::kSuccess ? plug.asFloat() : defaultValue;
 }
 
 double getDoubleAttr(const char* plugName, const MFnDependencyNode& dn, const double defaultValue)
 {
     MStatus status = MS::kSuccess;
-    const MPlug plug = dn.findPlug(plugName, &status);
+    const MPlug plug = findCachedPlug(dn, plugName, &status);
     return status == MStatus::kSuccess ? plug.asDouble() : defaultValue;
 }
 
@@ -158,7 +251,7 @@ MString getString(const char *plugName, const MFnDependencyNode& dn)
 {
     MDGContext ctx = MDGContext::fsNormal;
     MStatus stat = MS::kSuccess;
-    MPlug plug = dn.findPlug(plugName, &stat);
+    MPlug plug = findCachedPlug(dn, plugName, &stat);
     if (!stat)
         return "";
     return plug.asString(ctx, &stat);
@@ -168,7 +261,7 @@ MString getStringAttr(MString plugName, const MFnDependencyNode& dn, MString def
 {
     MDGContext ctx = MDGContext::fsNormal;
     MStatus stat = MS::kSuccess;
-    MPlug plug = dn.findPlug(plugName, &stat);
+    MPlug plug = findCachedPlug(dn, plugName.asChar(), &stat);
     if (!stat)
         return default_value;
     return plug.asString(ctx, &stat);
@@ -211,7 +304,7 @@ int getIntAttr(const char *plugName, const MFnDependencyNode& dn, int defaultVal
 {
     MDGContext ctx = MDGContext::fsNormal;
     MStatus stat = MS::kSuccess;
-    MPlug plug = dn.findPlug(plugName, &stat);
+    MPlug plug = findCachedPlug(dn, plugName, &stat);
     if (!stat)
         return defaultValue;
     return plug.asInt(ctx, &stat);
@@ -243,10 +336,9 @@ bool getBoolAttr(const char *plugName, const MFnDependencyNode& dn, bool default
 {
     MDGContext ctx = MDGContext::fsNormal;
     MStatus stat = MS::kSuccess;
-    bool result = false;
-    MPlug plug = dn.findPlug(plugName, &stat);
+    MPlug plug = findCachedPlug(dn, plugName, &stat);
     if (!stat)
-        return false;
+        return defaultValue;
     return plug.asBool(ctx, &stat);
 }
 
@@ -273,7 +365,7 @@ int getEnumInt(MString plugName, const MFnDependencyNode& dn)
 {
     MDGContext ctx = MDGContext::fsNormal;
     MStatus stat = MS::kSuccess;
-    MPlug plug = dn.findPlug(plugName, &stat);
+    MPlug plug = findCachedPlug(dn, plugName.asChar(), &stat);
     if (!stat)
         return -1;
     int value = plug.asShort(ctx, &stat);
@@ -389,7 +481,7 @@ bool getColor(const MString& plugName, const MFnDependencyNode& dn, MColor& valu
     }
 
     // I suppose the attribute is a color and has 3 children
-    MPlug plug = dn.findPlug(pn.c_str(), stat);
+    MPlug plug = findCachedPlug(dn, pn.c_str(), &stat);
     if (index >= 0)
         plug = plug[index];
     if (!stat)
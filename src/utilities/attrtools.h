@@ -45,6 +45,22 @@ enum ATTR_TYPE
     ATTR_TYPE_VECTOR = 3
 };
 
+// Resolve an attribute by name. The handles of static and extension attributes are cached
+// per node type, so repeated reads from nodes of the same type skip the name lookup.
+// Must be called from the main thread, like the Maya API.
+MObject findAttribute(const MFnDependencyNode& dn, const char* attrName);
+
+// Same as MFnDependencyNode::findPlug() but using the cached attribute handles.
+MPlug findCachedPlug(const MFnDependencyNode& dn, const char* attrName, MStatus* status = 0);
+
+// Has to be called before a render, node types can be redefined when a plugin is reloaded.
+void clearAttributeCache();
+
+// Called from the main thread when the plugin is loaded and unloaded. The cache
+// is cleared before any plugin is unloaded, since it may define cached node types.
+MStatus initializeAttributeCache();
+void uninitializeAttributeCache();
+
 int getChildId(const MPlug& plug);
 
 double getDegrees(const char* plugName, const MFnDependencyNode& dn);
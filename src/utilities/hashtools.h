@@ -26,67 +26,49 @@
 // THE SOFTWARE.
 //
 
-#ifndef UTILITIES_CONCURRENTQUEUE_H
-#define UTILITIES_CONCURRENTQUEUE_H
+#ifndef UTILITIES_HASHTOOLS_H
+#define UTILITIES_HASHTOOLS_H
 
-// Boost headers.
-#include "boost/thread/condition_variable.hpp"
-#include "boost/thread/mutex.hpp"
+// appleseed.foundation headers.
+#include "foundation/platform/types.h"
 
-// Standard headers.
-#include <queue>
+// Maya headers.
+#include <maya/MObjectHandle.h>
 
-template <typename Data>
-class concurrent_queue
-{
-  private:
-    std::queue<Data> the_queue;
-    mutable boost::mutex the_mutex;
-    boost::condition_variable my_condition_variable;
+// Standard headers.
+#include <cstddef>
+#include <cstring>
 
-  public:
-    void push(Data const& data)
-    {
-        boost::mutex::scoped_lock lock(the_mutex);
-        the_queue.push(data);
-        lock.unlock();
-        my_condition_variable.notify_one();
-    }
+// Initial value of a hash computed with hashBytes().
+const foundation::uint64 HashSeed = 14695981039346656037ULL;
 
-    bool empty() const
-    {
-        boost::mutex::scoped_lock lock(the_mutex);
-        return the_queue.empty();
-    }
+// Add a block of memory to a FNV-1a hash. The data is consumed in 64 bit
+// words, trailing bytes are hashed one by one.
+inline foundation::uint64 hashBytes(foundation::uint64 hash, const void* data, const size_t size)
+{
+    const foundation::uint8* bytes = static_cast<const foundation::uint8*>(data);
+    const size_t wordCount = size / sizeof(foundation::uint64);
 
-    size_t size() const
+    for (size_t i = 0; i < wordCount; ++i)
     {
-        return the_queue.size();
+        foundation::uint64 word;
+        memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
     }
 
-    bool try_pop(Data& popped_value)
-    {
-        boost::mutex::scoped_lock lock(the_mutex);
-        if (the_queue.empty())
-        {
-            return false;
-        }
+    for (size_t i = wordCount * sizeof(foundation::uint64); i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
 
-        popped_value = the_queue.front();
-        the_queue.pop();
-        return true;
-    }
+    return hash;
+}
 
-    void wait_and_pop(Data& popped_value)
+// Hash functor to key hash containers by Maya node.
+struct MObjectHandleHash
+{
+    size_t operator()(const MObjectHandle& handle) const
     {
-        boost::mutex::scoped_lock lock(the_mutex);
-        while (the_queue.empty())
-        {
-            my_condition_variable.wait(lock);
-        }
-        popped_value = the_queue.front();
-        the_queue.pop();
+        return handle.hashCode();
     }
 };
 
-#endif  // !UTILITIES_CONCURRENTQUEUE_H
+#endif  // !UTILITIES_HASHTOOLS_H
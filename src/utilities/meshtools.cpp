@@ -31,6 +31,7 @@
 
 // appleseed-maya headers.
 #include "utilities/attrtools.h"
+#include "utilities/hashtools.h"
 #include "utilities/logging.h"
 #include "utilities/tools.h"
 
@@ -39,27 +40,34 @@
 #include "renderer/api/utility.h"
 
 // Maya headers.
+#include <maya/MAnimControl.h>
+#include <maya/MColor.h>
 #include <maya/MFloatArray.h>
-#include <maya/MFloatVectorArray.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnMesh.h>
+#include <maya/MColorArray.h>
+#include <maya/MDGContext.h>
 #include <maya/MFnMeshData.h>
+#include <maya/MFnVectorArrayData.h>
 #include <maya/MIntArray.h>
-#include <maya/MItMeshPolygon.h>
-#include <maya/MPointArray.h>
+#include <maya/MItDependencyGraph.h>
+#include <maya/MMeshSmoothOptions.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MPlug.h>
 #include <maya/MStatus.h>
+#include <maya/MStringArray.h>
+#include <maya/MTime.h>
+#include <maya/MVectorArray.h>
 
-namespace
-{
-    renderer::GVector3 mPointToGVector3(const MPoint& p)
-    {
-        return
-            renderer::GVector3(
-                static_cast<float>(p.x),
-                static_cast<float>(p.y),
-                static_cast<float>(p.z));
-    }
-}
+// Boost headers.
+#include "boost/unordered_map.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 foundation::auto_release_ptr<renderer::MeshObject> defineStandardPlane()
 {
@@ -86,205 +94,790 @@ foundation::auto_release_ptr<renderer::MeshObject> defineStandardPlane()
 
 namespace
 {
-    void getMeshData(
-        const MObject&      meshObject,
-        MPointArray&        points,
-        MFloatVectorArray&  normals,
-        MFloatArray&        uArray,
-        MFloatArray&        vArray,
-        MIntArray&          triPointIndices,
-        MIntArray&          triNormalIndices,
-        MIntArray&          triUvIndices,
-        MIntArray&          triMatIndices,
-        MIntArray&          perFaceAssignments)
+    // Get the smooth mesh options used for rendering. Return false if the
+    // mesh is rendered unsmoothed.
+    bool getRenderSmoothOptions(MFnMesh& meshFn, MMeshSmoothOptions& options)
     {
         MStatus stat;
-        MMeshSmoothOptions options;
-        MFnMesh tmpMesh(meshObject, &stat);
-        MFnMeshData meshData;
-        MObject dataObject;
-        MObject smoothedObj;
-        MObject mObject = meshObject;
-        MString meshName = tmpMesh.name();
-
-        // create smooth mesh if needed
-        if (tmpMesh.findPlug("displaySmoothMesh").asBool())
+
+        if (!meshFn.findPlug("displaySmoothMesh").asBool())
+            return false;
+
+        if (!meshFn.getSmoothMeshDisplayOptions(options))
+            return false;
+
+        if (!meshFn.findPlug("useSmoothPreviewForRender", false, &stat).asBool())
         {
-            stat = tmpMesh.getSmoothMeshDisplayOptions(options);
-            if (stat)
-            {
-                if (!tmpMesh.findPlug("useSmoothPreviewForRender", false, &stat).asBool())
-                {
-                    int smoothLevel = tmpMesh.findPlug("renderSmoothLevel", false, &stat).asInt();
-                    options.setDivisions(smoothLevel);
-                }
-                if (options.divisions() > 0)
-                {
-                    dataObject = meshData.create();
-                    smoothedObj = tmpMesh.generateSmoothMesh(dataObject, &options, &stat);
-                    if (stat)
-                    {
-                        mObject = smoothedObj;
-                    }
-                }
-            }
+            int smoothLevel = meshFn.findPlug("renderSmoothLevel", false, &stat).asInt();
+            options.setDivisions(smoothLevel);
         }
 
-        MFnMesh meshFn(mObject, &stat);
-        CHECK_MSTATUS(stat);
-        MItMeshPolygon faceIt(mObject, &stat);
-        CHECK_MSTATUS(stat);
+        return options.divisions() > 0;
+    }
 
-        meshFn.getPoints(points);
-        meshFn.getNormals(normals, MSpace::kObject);
-        meshFn.getUVs(uArray, vArray);
+    // The smooth options a smooth mesh was generated with.
+    struct SmoothOptions
+    {
+        int     divisions;
+        float   smoothness;
+        bool    smoothUVs;
+        bool    propEdgeHardness;
+        bool    keepBorder;
+        bool    keepHardEdge;
+        int     boundaryRule;
+
+        explicit SmoothOptions(const MMeshSmoothOptions& options)
+          : divisions(options.divisions())
+          , smoothness(options.smoothness())
+          , smoothUVs(options.smoothUVs())
+          , propEdgeHardness(options.propEdgeHardness())
+          , keepBorder(options.keepBorder())
+          , keepHardEdge(options.keepHardEdge())
+          , boundaryRule(options.boundaryRule())
+        {
+        }
 
-        uint numVertices = points.length();
-        uint numNormals = normals.length();
-        uint numUvs = uArray.length();
+        bool operator==(const SmoothOptions& other) const
+        {
+            return
+                divisions == other.divisions &&
+                smoothness == other.smoothness &&
+                smoothUVs == other.smoothUVs &&
+                propEdgeHardness == other.propEdgeHardness &&
+                keepBorder == other.keepBorder &&
+                keepHardEdge == other.keepHardEdge &&
+                boundaryRule == other.boundaryRule;
+        }
+    };
 
-        // some meshes may have no uv's
-        // to avoid problems I add a default uv coordinate
-        if (numUvs == 0)
+    // A smooth mesh generated while a SmoothMeshCacheScope exists.
+    struct SmoothMesh
+    {
+        MTime           time;
+        SmoothOptions   options;
+        MObject         data;       // owns mesh
+        MObject         mesh;
+
+        SmoothMesh(const MTime& time, const SmoothOptions& options)
+          : time(time)
+          , options(options)
+        {
+        }
+    };
+
+    typedef boost::unordered_multimap<MObjectHandle, SmoothMesh, MObjectHandleHash> SmoothMeshCache;
+
+    // Only used from the main thread, like the Maya API.
+    SmoothMeshCache smoothMeshCache;
+    size_t smoothMeshCacheScopes = 0;
+
+    const SmoothMesh* findSmoothMesh(
+        const MObjectHandle&    node,
+        const MTime&            time,
+        const SmoothOptions&    options)
+    {
+        const std::pair<SmoothMeshCache::const_iterator, SmoothMeshCache::const_iterator> range =
+            smoothMeshCache.equal_range(node);
+
+        for (SmoothMeshCache::const_iterator i = range.first; i != range.second; ++i)
         {
-            uArray.append(0.0);
-            vArray.append(0.0);
+            if (i->second.time == time && i->second.options == options)
+                return &i->second;
         }
-        for (uint nid = 0; nid < numNormals; nid++)
+
+        return 0;
+    }
+}
+
+SmoothMeshCacheScope::SmoothMeshCacheScope()
+{
+    ++smoothMeshCacheScopes;
+}
+
+SmoothMeshCacheScope::~SmoothMeshCacheScope()
+{
+    if (--smoothMeshCacheScopes == 0)
+        smoothMeshCache.clear();
+}
+
+MObject getRenderMesh(const MObject& meshObject, MObject& smoothMeshData)
+{
+    return getRenderMesh(meshObject, meshObject, MAnimControl::currentTime(), smoothMeshData);
+}
+
+MObject getRenderMesh(const MObject& meshObject, const MObject& meshData, const MTime& time, MObject& smoothMeshData)
+{
+    MStatus stat;
+    MMeshSmoothOptions options;
+    MFnMesh tmpMesh(meshObject, &stat);
+
+    // create smooth mesh if needed
+    if (getRenderSmoothOptions(tmpMesh, options))
+    {
+        const MObjectHandle node(meshObject);
+        const SmoothOptions smoothOptions(options);
+        if (smoothMeshCacheScopes > 0)
         {
-            if (normals[nid].length() < 0.1f)
-                Logging::warning(MString("Malformed normal in ") + meshName);
+            if (const SmoothMesh* cached = findSmoothMesh(node, time, smoothOptions))
+            {
+                smoothMeshData = cached->data;
+                return cached->mesh;
+            }
         }
-        MPointArray triPoints;
-        MIntArray triVtxIds;
-        MIntArray faceVtxIds;
-        MIntArray faceNormalIds;
 
-        for (faceIt.reset(); !faceIt.isDone(); faceIt.next())
+        MFnMesh dataMesh(meshData, &stat);
+        MFnMeshData smoothData;
+        smoothMeshData = smoothData.create();
+        MObject smoothedObj = dataMesh.generateSmoothMesh(smoothMeshData, &options, &stat);
+        if (stat)
         {
-            int faceId = faceIt.index();
-            int numTris;
-            faceIt.numTriangles(numTris);
-            faceIt.getVertices(faceVtxIds);
+            if (smoothMeshCacheScopes > 0)
+            {
+                SmoothMesh smoothMesh(time, smoothOptions);
+                smoothMesh.data = smoothMeshData;
+                smoothMesh.mesh = smoothedObj;
+                smoothMeshCache.insert(std::make_pair(node, smoothMesh));
+            }
+
+            return smoothedObj;
+        }
+    }
+
+    return meshData;
+}
+
+int getRenderSmoothLevel(const MObject& meshObject)
+{
+    MMeshSmoothOptions options;
+    MFnMesh tmpMesh(meshObject);
+    return getRenderSmoothOptions(tmpMesh, options) ? options.divisions() : 0;
+}
+
+foundation::uint64 hashRenderSmoothOptions(foundation::uint64 hash, const MObject& meshObject)
+{
+    MMeshSmoothOptions options;
+    MFnMesh tmpMesh(meshObject);
+    if (!getRenderSmoothOptions(tmpMesh, options))
+        return hash;
+
+    // Field by field, the padding of SmoothOptions is undefined.
+    const SmoothOptions smoothOptions(options);
+    hash = hashBytes(hash, &smoothOptions.divisions, sizeof(smoothOptions.divisions));
+    hash = hashBytes(hash, &smoothOptions.smoothness, sizeof(smoothOptions.smoothness));
+    hash = hashBytes(hash, &smoothOptions.smoothUVs, sizeof(smoothOptions.smoothUVs));
+    hash = hashBytes(hash, &smoothOptions.propEdgeHardness, sizeof(smoothOptions.propEdgeHardness));
+    hash = hashBytes(hash, &smoothOptions.keepBorder, sizeof(smoothOptions.keepBorder));
+    hash = hashBytes(hash, &smoothOptions.keepHardEdge, sizeof(smoothOptions.keepHardEdge));
+    hash = hashBytes(hash, &smoothOptions.boundaryRule, sizeof(smoothOptions.boundaryRule));
+
+    return hash;
+}
+
+foundation::auto_release_ptr<renderer::MeshObject> createMesh(const MObject& mobject)
+{
+    MStatus stat = MStatus::kSuccess;
+    MObject smoothMeshData;
+    MFnMesh meshFn(getRenderMesh(mobject, smoothMeshData), &stat);
+    CHECK_MSTATUS(stat);
+
+    MeshArrays arrays;
+    getMeshArrays(meshFn, MIntArray(), 0, arrays);
+
+    size_t degenerateNormalCount;
+    foundation::auto_release_ptr<renderer::MeshObject> mesh(
+        buildMesh(
+            makeGoodString(MFnMesh(mobject).fullPathName()).asChar(),
+            arrays,
+            degenerateNormalCount));
+
+    if (degenerateNormalCount > 0)
+        Logging::warning(MString("Malformed normal in ") + meshFn.name());
+
+    return mesh;
+}
+
+void getMeshTopology(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    MeshTopology&           topology)
+{
+    meshFn.getVertices(topology.faceVertexCounts, topology.faceVertexIds);
+
+    MIntArray faceNormalCounts;
+    meshFn.getNormalIds(faceNormalCounts, topology.faceNormalIds);
+
+    topology.faceUvCounts.clear();
+    topology.faceUvIds.clear();
+    if (meshFn.numUVs() > 0)
+        meshFn.getAssignedUVs(topology.faceUvCounts, topology.faceUvIds);
+
+    meshFn.getTriangleOffsets(topology.triangleCounts, topology.triangleOffsets);
+
+    topology.perFaceAssignments = perFaceAssignments;
+}
+
+void triangulateMesh(
+    const MeshTopology&     topology,
+    MeshTriangles&          triangles)
+{
+    const unsigned int numFaces = topology.faceVertexCounts.length();
+    const unsigned int numTriangles = topology.triangleOffsets.length() / 3;
+    const bool hasAssignments = topology.perFaceAssignments.length() == numFaces;
+    const bool hasUvs = topology.faceUvCounts.length() == numFaces;
 
-            int perFaceShadingGroup = 0;
-            if (perFaceAssignments.length() > 0)
-                perFaceShadingGroup = perFaceAssignments[faceId];
+    triangles.pointIndices.setLength(numTriangles * 3);
+    triangles.normalIndices.setLength(numTriangles * 3);
+    triangles.uvIndices.setLength(numTriangles * 3);
+    triangles.materialIndices.setLength(numTriangles);
 
-            MIntArray faceUVIndices;
+    unsigned int faceVertexBase = 0;
+    unsigned int uvBase = 0;
+    unsigned int triangleIndex = 0;
 
-            faceNormalIds.clear();
-            for (uint vtxId = 0; vtxId < faceVtxIds.length(); vtxId++)
+    for (unsigned int faceIndex = 0; faceIndex < numFaces; ++faceIndex)
+    {
+        const int material = hasAssignments ? topology.perFaceAssignments[faceIndex] : 0;
+        const bool faceHasUvs = hasUvs && topology.faceUvCounts[faceIndex] > 0;
+        const int numFaceTriangles = topology.triangleCounts[faceIndex];
+
+        for (int i = 0; i < numFaceTriangles; ++i, ++triangleIndex)
+        {
+            for (unsigned int j = 0; j < 3; ++j)
             {
-                faceNormalIds.append(faceIt.normalIndex(vtxId));
-                int uvIndex;
-                if (numUvs == 0)
-                {
-                    faceUVIndices.append(0);
-                }
-                else
-                {
-                    faceIt.getUVIndex(vtxId, uvIndex);
-                    faceUVIndices.append(uvIndex);
-                }
+                const unsigned int index = triangleIndex * 3 + j;
+                const unsigned int offset = static_cast<unsigned int>(topology.triangleOffsets[index]);
+                triangles.pointIndices[index] = topology.faceVertexIds[faceVertexBase + offset];
+                triangles.normalIndices[index] = topology.faceNormalIds[faceVertexBase + offset];
+                triangles.uvIndices[index] = faceHasUvs ? topology.faceUvIds[uvBase + offset] : 0;
             }
 
-            for (int triId = 0; triId < numTris; triId++)
+            triangles.materialIndices[triangleIndex] = material;
+        }
+
+        faceVertexBase += topology.faceVertexCounts[faceIndex];
+        if (hasUvs)
+            uvBase += topology.faceUvCounts[faceIndex];
+    }
+}
+
+void triangulateMesh(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    MeshTriangles&          triangles)
+{
+    MeshTopology topology;
+    getMeshTopology(meshFn, perFaceAssignments, topology);
+    triangulateMesh(topology, triangles);
+}
+
+void getMeshArrays(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    const size_t            materialSlotCount,
+    MeshArrays&             arrays)
+{
+    // Vertices and normals are read straight from Maya's internal float arrays.
+    const float* points = meshFn.getRawPoints(0);
+    const size_t numPoints = points != 0 ? static_cast<size_t>(meshFn.numVertices()) : 0;
+    arrays.points.assign(points, points + numPoints * 3);
+
+    const float* normals = meshFn.getRawNormals(0);
+    const size_t numNormals = normals != 0 ? static_cast<size_t>(meshFn.numNormals()) : 0;
+    arrays.normals.assign(normals, normals + numNormals * 3);
+
+    MFloatArray uArray, vArray;
+    meshFn.getUVs(uArray, vArray);
+    arrays.uvs.resize(uArray.length() * 2);
+    for (unsigned int i = 0; i < uArray.length(); ++i)
+    {
+        arrays.uvs[i * 2 + 0] = uArray[i];
+        arrays.uvs[i * 2 + 1] = vArray[i];
+    }
+
+    getMeshTopology(meshFn, perFaceAssignments, arrays.topology);
+    arrays.materialSlotCount = materialSlotCount;
+
+    arrays.pointPoses.clear();
+    arrays.normalPoses.clear();
+}
+
+bool hasAnimatedHistory(const MObject& meshObject)
+{
+    MStatus stat;
+    MFnDependencyNode depFn(meshObject);
+    MPlug inMeshPlug = depFn.findPlug("inMesh", false, &stat);
+    if (!stat || !inMeshPlug.isConnected())
+        return false;
+
+    MItDependencyGraph it(
+        inMeshPlug,
+        MFn::kInvalid,
+        MItDependencyGraph::kUpstream,
+        MItDependencyGraph::kDepthFirst,
+        MItDependencyGraph::kNodeLevel,
+        &stat);
+    if (!stat)
+        return true;
+
+    for (; !it.isDone(); it.next())
+    {
+        const MObject node = it.currentItem();
+        if (node.hasFn(MFn::kAnimCurve) || node.hasFn(MFn::kExpression) || node.hasFn(MFn::kTime))
+            return true;
+    }
+
+    return false;
+}
+
+bool getMeshPoses(
+    const MObject&              meshObject,
+    const std::vector<MTime>&   times,
+    MeshArrays&                 arrays)
+{
+    if (times.size() < 2)
+        return true;
+
+    MStatus stat;
+    MFnDependencyNode depFn(meshObject);
+    MPlug outMeshPlug = depFn.findPlug("outMesh", false, &stat);
+    if (!stat)
+        return true;
+
+    const size_t numPoints = arrays.points.size() / 3;
+    const size_t numNormals = arrays.normals.size() / 3;
+
+    std::vector<std::vector<float> > points(times.size());
+    std::vector<std::vector<float> > normals(times.size());
+    bool moving = false;
+
+    for (size_t i = 0; i < times.size(); ++i)
+    {
+        MDGContext context(times[i]);
+        MObject meshData = outMeshPlug.asMObject(context, &stat);
+        if (!stat || meshData.isNull())
+            return true;
+
+        MObject smoothMeshData;
+        MFnMesh meshFn(getRenderMesh(meshObject, meshData, times[i], smoothMeshData), &stat);
+        if (!stat)
+            return true;
+
+        // Poses can only be interpolated if every vertex and normal has a counterpart.
+        if (static_cast<size_t>(meshFn.numVertices()) != numPoints ||
+            static_cast<size_t>(meshFn.numNormals()) != numNormals ||
+            static_cast<unsigned int>(meshFn.numPolygons()) != arrays.topology.faceVertexCounts.length() ||
+            static_cast<unsigned int>(meshFn.numFaceVertices()) != arrays.topology.faceVertexIds.length())
+            return false;
+
+        const float* rawPoints = meshFn.getRawPoints(0);
+        const float* rawNormals = meshFn.getRawNormals(0);
+        if ((numPoints > 0 && rawPoints == 0) || (numNormals > 0 && rawNormals == 0))
+            return true;
+
+        points[i].assign(rawPoints, rawPoints + numPoints * 3);
+        normals[i].assign(rawNormals, rawNormals + numNormals * 3);
+
+        if (i > 0 && (points[i] != points[0] || normals[i] != normals[0]))
+            moving = true;
+    }
+
+    if (!moving)
+        return true;
+
+    arrays.points.swap(points[0]);
+    arrays.normals.swap(normals[0]);
+
+    arrays.pointPoses.resize(times.size() - 1);
+    arrays.normalPoses.resize(times.size() - 1);
+    for (size_t i = 1; i < times.size(); ++i)
+    {
+        arrays.pointPoses[i - 1].swap(points[i]);
+        arrays.normalPoses[i - 1].swap(normals[i]);
+    }
+
+    return true;
+}
+
+namespace
+{
+    void pushMeshVertices(const std::vector<float>& points, renderer::MeshObject& mesh)
+    {
+        const size_t numVertices = points.size() / 3;
+        mesh.reserve_vertices(numVertices);
+
+        for (size_t i = 0; i < numVertices; ++i)
+            mesh.push_vertex(renderer::GVector3(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]));
+    }
+
+    size_t pushMeshNormals(const std::vector<float>& normals, renderer::MeshObject& mesh)
+    {
+        const size_t numNormals = normals.size() / 3;
+        mesh.reserve_vertex_normals(numNormals);
+
+        // Normalize in batches through a small buffer so that the loop over the
+        // components stays simple enough to be vectorized.
+        const size_t BatchSize = 1024;
+        float batch[BatchSize * 3];
+        size_t numDegenerate = 0;
+
+        for (size_t begin = 0; begin < numNormals; begin += BatchSize)
+        {
+            const size_t count = std::min(BatchSize, numNormals - begin);
+            const float* source = &normals[begin * 3];
+
+            for (size_t i = 0; i < count; ++i)
             {
-                int faceRelIds[3];
-                faceIt.getTriangle(triId, triPoints, triVtxIds);
+                const float x = source[i * 3 + 0];
+                const float y = source[i * 3 + 1];
+                const float z = source[i * 3 + 2];
+                const float squareLength = x * x + y * y + z * z;
+                const float scale = squareLength > 1.0e-12f ? 1.0f / std::sqrt(squareLength) : 0.0f;
+                batch[i * 3 + 0] = x * scale;
+                batch[i * 3 + 1] = y * scale;
+                batch[i * 3 + 2] = z * scale;
+            }
 
-                for (uint triVtxId = 0; triVtxId < 3; triVtxId++)
+            for (size_t i = 0; i < count; ++i)
+            {
+                renderer::GVector3 n(batch[i * 3 + 0], batch[i * 3 + 1], batch[i * 3 + 2]);
+                if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
                 {
-                    for (uint faceVtxId = 0; faceVtxId < faceVtxIds.length(); faceVtxId++)
-                    {
-                        if (faceVtxIds[faceVtxId] == triVtxIds[triVtxId])
-                        {
-                            faceRelIds[triVtxId] = faceVtxId;
-                        }
-                    }
+                    n[1] = 1.0f;
+                    ++numDegenerate;
                 }
+                mesh.push_vertex_normal(n);
+            }
+        }
+
+        return numDegenerate;
+    }
+
+    // Same normalization as pushMeshNormals(), for a single normal.
+    renderer::GVector3 makeNormal(const float* normal)
+    {
+        const float squareLength = normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2];
+        if (squareLength <= 1.0e-12f)
+            return renderer::GVector3(0.0f, 1.0f, 0.0f);
+
+        const float scale = 1.0f / std::sqrt(squareLength);
+        return renderer::GVector3(normal[0] * scale, normal[1] * scale, normal[2] * scale);
+    }
+
+    void pushMeshPoses(const MeshArrays& arrays, renderer::MeshObject& mesh)
+    {
+        const size_t numSegments = arrays.pointPoses.size();
+        if (numSegments == 0)
+            return;
+
+        mesh.set_motion_segment_count(numSegments);
+
+        for (size_t s = 0; s < numSegments; ++s)
+        {
+            const std::vector<float>& points = arrays.pointPoses[s];
+            for (size_t i = 0, e = points.size() / 3; i < e; ++i)
+                mesh.set_vertex_pose(i, s, renderer::GVector3(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]));
+
+            const std::vector<float>& normals = arrays.normalPoses[s];
+            for (size_t i = 0, e = normals.size() / 3; i < e; ++i)
+                mesh.set_vertex_normal_pose(i, s, makeNormal(&normals[i * 3]));
+        }
+    }
+
+    void pushMeshTexCoords(const std::vector<float>& uvs, renderer::MeshObject& mesh)
+    {
+        const size_t numUvs = uvs.size() / 2;
+        if (numUvs == 0)
+        {
+            mesh.push_tex_coords(renderer::GVector2(0.0f, 0.0f));
+            return;
+        }
+
+        mesh.reserve_tex_coords(numUvs);
+
+        for (size_t i = 0; i < numUvs; ++i)
+            mesh.push_tex_coords(renderer::GVector2(uvs[i * 2 + 0], uvs[i * 2 + 1]));
+    }
+
+    void pushMeshTriangles(const MeshTriangles& triangles, renderer::MeshObject& mesh)
+    {
+        const unsigned int numTris = triangles.size();
+        mesh.reserve_triangles(numTris);
 
-                uint vtxId0 = faceVtxIds[faceRelIds[0]];
-                uint vtxId1 = faceVtxIds[faceRelIds[1]];
-                uint vtxId2 = faceVtxIds[faceRelIds[2]];
-                uint normalId0 = faceNormalIds[faceRelIds[0]];
-                uint normalId1 = faceNormalIds[faceRelIds[1]];
-                uint normalId2 = faceNormalIds[faceRelIds[2]];
-                uint uvId0 = faceUVIndices[faceRelIds[0]];
-                uint uvId1 = faceUVIndices[faceRelIds[1]];
-                uint uvId2 = faceUVIndices[faceRelIds[2]];
-
-                triPointIndices.append(vtxId0);
-                triPointIndices.append(vtxId1);
-                triPointIndices.append(vtxId2);
-
-                triNormalIndices.append(normalId0);
-                triNormalIndices.append(normalId1);
-                triNormalIndices.append(normalId2);
-
-                triUvIndices.append(uvId0);
-                triUvIndices.append(uvId1);
-                triUvIndices.append(uvId2);
-
-                triMatIndices.append(perFaceShadingGroup);
+        for (unsigned int i = 0, index = 0; i < numTris; ++i, index += 3)
+        {
+            mesh.push_triangle(
+                renderer::Triangle(
+                    triangles.pointIndices[index + 0], triangles.pointIndices[index + 1], triangles.pointIndices[index + 2],
+                    triangles.normalIndices[index + 0], triangles.normalIndices[index + 1], triangles.normalIndices[index + 2],
+                    triangles.uvIndices[index + 0], triangles.uvIndices[index + 1], triangles.uvIndices[index + 2],
+                    triangles.materialIndices[i]));
+        }
+    }
+}
+
+bool getMeshVelocities(
+    const MObject&              meshObject,
+    const MStringArray&         sources,
+    std::vector<float>&         velocities)
+{
+    MStatus stat;
+    MObject smoothMeshData;
+    MFnMesh meshFn(getRenderMesh(meshObject, smoothMeshData), &stat);
+    if (!stat)
+        return false;
+
+    for (unsigned int i = 0; i < sources.length(); ++i)
+    {
+        const MString& source = sources[i];
+        if (source.length() == 0)
+            continue;
+
+        if (meshFn.hasColorChannels(source))
+        {
+            // Vertices without a color don't move.
+            const MColor unsetColor(0.0f, 0.0f, 0.0f, 0.0f);
+            MColorArray colors;
+            meshFn.getVertexColors(colors, &source, &unsetColor);
+            velocities.resize(colors.length() * 3);
+            for (unsigned int v = 0; v < colors.length(); ++v)
+            {
+                velocities[v * 3 + 0] = colors[v].r;
+                velocities[v * 3 + 1] = colors[v].g;
+                velocities[v * 3 + 2] = colors[v].b;
             }
+            return true;
         }
+
+        // Attributes only exist on the shape, not on the smoothed mesh data.
+        MPlug plug = MFnDependencyNode(meshObject).findPlug(source, false, &stat);
+        if (!stat)
+            continue;
+
+        MObject data = plug.asMObject(MDGContext::fsNormal, &stat);
+        if (!stat || !data.hasFn(MFn::kVectorArrayData))
+            continue;
+
+        const MVectorArray vectors = MFnVectorArrayData(data).array();
+        velocities.resize(vectors.length() * 3);
+        for (unsigned int v = 0; v < vectors.length(); ++v)
+        {
+            velocities[v * 3 + 0] = static_cast<float>(vectors[v].x);
+            velocities[v * 3 + 1] = static_cast<float>(vectors[v].y);
+            velocities[v * 3 + 2] = static_cast<float>(vectors[v].z);
+        }
+        return true;
     }
+
+    return false;
 }
 
-foundation::auto_release_ptr<renderer::MeshObject> createMesh(const MObject& mobject)
+bool getVelocityPoses(
+    const std::vector<float>&   velocities,
+    const std::vector<double>&  offsets,
+    MeshArrays&                 arrays)
 {
-    MStatus stat = MStatus::kSuccess;
-    MFnMesh meshFn(mobject, &stat);
-    CHECK_MSTATUS(stat);
+    if (velocities.size() != arrays.points.size())
+        return false;
 
-    MPointArray points;
-    MFloatVectorArray normals;
-    MFloatArray uArray, vArray;
-    MIntArray triPointIds, triNormalIds, triUvIds, triMatIds, perFaceAssignments;
-    getMeshData(mobject, points, normals, uArray, vArray, triPointIds, triNormalIds, triUvIds, triMatIds, perFaceAssignments);
+    if (offsets.size() < 2)
+        return true;
+
+    const size_t numValues = arrays.points.size();
 
+    arrays.pointPoses.assign(offsets.size() - 1, std::vector<float>(numValues));
+    arrays.normalPoses.assign(offsets.size() - 1, arrays.normals);
+
+    for (size_t k = 1; k < offsets.size(); ++k)
+    {
+        const float offset = static_cast<float>(offsets[k]);
+        std::vector<float>& pose = arrays.pointPoses[k - 1];
+        for (size_t i = 0; i < numValues; ++i)
+            pose[i] = arrays.points[i] + velocities[i] * offset;
+    }
+
+    const float firstOffset = static_cast<float>(offsets[0]);
+    for (size_t i = 0; i < numValues; ++i)
+        arrays.points[i] += velocities[i] * firstOffset;
+
+    return true;
+}
+
+foundation::auto_release_ptr<renderer::MeshObject> buildMesh(
+    const char*             name,
+    const MeshArrays&       arrays,
+    size_t&                 degenerateNormalCount)
+{
     foundation::auto_release_ptr<renderer::MeshObject> mesh(
-        renderer::MeshObjectFactory::create(
-            makeGoodString(meshFn.fullPathName()).asChar(),
-            renderer::ParamArray()));
+        renderer::MeshObjectFactory::create(name, renderer::ParamArray()));
 
-    for (unsigned int i = 0; i < points.length(); i++)
-        mesh->push_vertex(mPointToGVector3(points[i]));
+    pushMeshVertices(arrays.points, mesh.ref());
+    degenerateNormalCount = pushMeshNormals(arrays.normals, mesh.ref());
+    pushMeshPoses(arrays, mesh.ref());
+    pushMeshTexCoords(arrays.uvs, mesh.ref());
 
-    for (unsigned int i = 0; i < normals.length(); i++)
-        mesh->push_vertex_normal(mPointToGVector3(normals[i]));
+    mesh->reserve_material_slots(arrays.materialSlotCount);
+    for (size_t i = 0; i < arrays.materialSlotCount; ++i)
+    {
+        char slotName[32];
+        sprintf(slotName, "slot%u", static_cast<unsigned int>(i));
+        mesh->push_material_slot(slotName);
+    }
+
+    MeshTriangles triangles;
+    triangulateMesh(arrays.topology, triangles);
+    pushMeshTriangles(triangles, mesh.ref());
 
-    for (unsigned int i = 0; i < uArray.length(); i++)
+    return mesh;
+}
+
+namespace
+{
+    foundation::uint64 hashTriangle(const foundation::uint64 hash, const renderer::Triangle& triangle)
     {
-        mesh->push_tex_coords(
-            renderer::GVector2(
-                static_cast<float>(uArray[i]),
-                static_cast<float>(vArray[i])));
+        const foundation::uint32 indices[10] =
+        {
+            triangle.m_v0, triangle.m_v1, triangle.m_v2,
+            triangle.m_n0, triangle.m_n1, triangle.m_n2,
+            triangle.m_a0, triangle.m_a1, triangle.m_a2,
+            triangle.m_pa
+        };
+
+        return hashBytes(hash, indices, sizeof(indices));
     }
 
-    const unsigned int numTris = triPointIds.length() / 3;
+    bool sameTriangle(const renderer::Triangle& lhs, const renderer::Triangle& rhs)
+    {
+        return
+            lhs.m_v0 == rhs.m_v0 && lhs.m_v1 == rhs.m_v1 && lhs.m_v2 == rhs.m_v2 &&
+            lhs.m_n0 == rhs.m_n0 && lhs.m_n1 == rhs.m_n1 && lhs.m_n2 == rhs.m_n2 &&
+            lhs.m_a0 == rhs.m_a0 && lhs.m_a1 == rhs.m_a1 && lhs.m_a2 == rhs.m_a2 &&
+            lhs.m_pa == rhs.m_pa;
+    }
+}
 
-    for (unsigned int i = 0; i < numTris; i++)
+foundation::uint64 hashMeshContent(const renderer::MeshObject& mesh)
+{
+    const size_t counts[6] =
     {
-        const int perFaceShadingGroup = triMatIds[i];
-        const int vtxId0 = triPointIds[i * 3 + 0];
-        const int vtxId1 = triPointIds[i * 3 + 1];
-        const int vtxId2 = triPointIds[i * 3 + 2];
-        const int normalId0 = triNormalIds[i * 3 + 0];
-        const int normalId1 = triNormalIds[i * 3 + 1];
-        const int normalId2 = triNormalIds[i * 3 + 2];
-        const int uvId0 = triUvIds[i * 3 + 0];
-        const int uvId1 = triUvIds[i * 3 + 1];
-        const int uvId2 = triUvIds[i * 3 + 2];
-        mesh->push_triangle(
-            renderer::Triangle(
-                vtxId0, vtxId1, vtxId2,
-                normalId0, normalId1, normalId2,
-                uvId0, uvId1, uvId2,
-                perFaceShadingGroup));
+        mesh.get_vertex_count(),
+        mesh.get_vertex_normal_count(),
+        mesh.get_tex_coords_count(),
+        mesh.get_triangle_count(),
+        mesh.get_material_slot_count(),
+        mesh.get_motion_segment_count()
+    };
+
+    foundation::uint64 hash = hashBytes(HashSeed, counts, sizeof(counts));
+
+    for (size_t i = 0; i < counts[0]; ++i)
+        hash = hashBytes(hash, &mesh.get_vertex(i)[0], sizeof(renderer::GVector3));
+
+    for (size_t i = 0; i < counts[1]; ++i)
+        hash = hashBytes(hash, &mesh.get_vertex_normal(i)[0], sizeof(renderer::GVector3));
+
+    for (size_t i = 0; i < counts[2]; ++i)
+    {
+        const renderer::GVector2 uv = mesh.get_tex_coords(i);
+        hash = hashBytes(hash, &uv[0], sizeof(uv));
     }
 
-    return mesh;
+    for (size_t i = 0; i < counts[3]; ++i)
+        hash = hashTriangle(hash, mesh.get_triangle(i));
+
+    for (size_t i = 0; i < counts[4]; ++i)
+    {
+        const char* slot = mesh.get_material_slot(i);
+        hash = hashBytes(hash, slot, strlen(slot));
+    }
+
+    for (size_t s = 0; s < counts[5]; ++s)
+    {
+        for (size_t i = 0; i < counts[0]; ++i)
+        {
+            const renderer::GVector3 pose = mesh.get_vertex_pose(i, s);
+            hash = hashBytes(hash, &pose[0], sizeof(pose));
+        }
+
+        for (size_t i = 0; i < counts[1]; ++i)
+        {
+            const renderer::GVector3 pose = mesh.get_vertex_normal_pose(i, s);
+            hash = hashBytes(hash, &pose[0], sizeof(pose));
+        }
+    }
+
+    return hash;
+}
+
+bool haveSameContent(const renderer::MeshObject& lhs, const renderer::MeshObject& rhs)
+{
+    if (lhs.get_vertex_count() != rhs.get_vertex_count() ||
+        lhs.get_vertex_normal_count() != rhs.get_vertex_normal_count() ||
+        lhs.get_tex_coords_count() != rhs.get_tex_coords_count() ||
+        lhs.get_triangle_count() != rhs.get_triangle_count() ||
+        lhs.get_material_slot_count() != rhs.get_material_slot_count() ||
+        lhs.get_motion_segment_count() != rhs.get_motion_segment_count())
+        return false;
+
+    for (size_t i = 0, e = lhs.get_vertex_count(); i < e; ++i)
+    {
+        if (lhs.get_vertex(i) != rhs.get_vertex(i))
+            return false;
+    }
+
+    for (size_t i = 0, e = lhs.get_vertex_normal_count(); i < e; ++i)
+    {
+        if (lhs.get_vertex_normal(i) != rhs.get_vertex_normal(i))
+            return false;
+    }
+
+    for (size_t i = 0, e = lhs.get_tex_coords_count(); i < e; ++i)
+    {
+        if (lhs.get_tex_coords(i) != rhs.get_tex_coords(i))
+            return false;
+    }
+
+    for (size_t i = 0, e = lhs.get_triangle_count(); i < e; ++i)
+    {
+        if (!sameTriangle(lhs.get_triangle(i), rhs.get_triangle(i)))
+            return false;
+    }
+
+    for (size_t i = 0, e = lhs.get_material_slot_count(); i < e; ++i)
+    {
+        if (strcmp(lhs.get_material_slot(i), rhs.get_material_slot(i)) != 0)
+            return false;
+    }
+
+    for (size_t s = 0, se = lhs.get_motion_segment_count(); s < se; ++s)
+    {
+        for (size_t i = 0, e = lhs.get_vertex_count(); i < e; ++i)
+        {
+            if (lhs.get_vertex_pose(i, s) != rhs.get_vertex_pose(i, s))
+                return false;
+        }
+
+        for (size_t i = 0, e = lhs.get_vertex_normal_count(); i < e; ++i)
+        {
+            if (lhs.get_vertex_normal_pose(i, s) != rhs.get_vertex_normal_pose(i, s))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+size_t getMeshMemorySize(const renderer::MeshObject& mesh)
+{
+    return
+        (mesh.get_vertex_count() + mesh.get_vertex_normal_count()) * sizeof(renderer::GVector3) +
+        mesh.get_tex_coords_count() * sizeof(renderer::GVector2) +
+        mesh.get_triangle_count() * sizeof(renderer::Triangle) +
+        getMeshPosesMemorySize(mesh);
+}
+
+size_t getMeshPosesMemorySize(const renderer::MeshObject& mesh)
+{
+    return
+        (mesh.get_vertex_count() + mesh.get_vertex_normal_count()) *
+        mesh.get_motion_segment_count() * sizeof(renderer::GVector3);
 }
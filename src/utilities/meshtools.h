@@ -30,13 +30,185 @@
 #define UTILITIES_MESHTOOLS_H
 
 // appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/platform/types.h"
 #include "foundation/utility/autoreleaseptr.h"
 
+// Maya headers.
+#include <maya/MIntArray.h>
+
+// Standard headers.
+#include <cstddef>
+#include <vector>
+
 // Forward declarations.
 namespace renderer  { class MeshObject; }
+class MFnMesh;
 class MObject;
+class MStringArray;
+class MTime;
 
 foundation::auto_release_ptr<renderer::MeshObject> defineStandardPlane();
 foundation::auto_release_ptr<renderer::MeshObject> createMesh(const MObject& mobject);
 
+// Return the mesh to translate: the smooth mesh preview if it is used for
+// rendering, meshObject otherwise. The smoothed mesh is owned by
+// smoothMeshData, which must outlive it.
+MObject getRenderMesh(const MObject& meshObject, MObject& smoothMeshData);
+
+// Same as above for mesh data of meshObject evaluated at the given time, e.g.
+// its output mesh at a motion step. The smoothing options are read from meshObject.
+MObject getRenderMesh(const MObject& meshObject, const MObject& meshData, const MTime& time, MObject& smoothMeshData);
+
+// While a scope exists, the smooth meshes generated by getRenderMesh() are
+// kept and shared by all callers asking for the same mesh node at the same
+// time with the same smooth options, so a mesh is only subdivided once per
+// evaluation. The scene must not change while the scope exists. Scopes can
+// be nested, the smooth meshes are released with the outermost one.
+class SmoothMeshCacheScope
+  : public foundation::NonCopyable
+{
+  public:
+    SmoothMeshCacheScope();
+    ~SmoothMeshCacheScope();
+};
+
+// Return the number of smooth mesh subdivisions used for rendering, 0 if the
+// mesh is rendered unsmoothed.
+int getRenderSmoothLevel(const MObject& meshObject);
+
+// Add the smooth mesh options used for rendering to a hash computed with
+// hashBytes(). Nothing is added if the mesh is rendered unsmoothed.
+foundation::uint64 hashRenderSmoothOptions(foundation::uint64 hash, const MObject& meshObject);
+
+// Topology of a mesh as read from Maya in bulk: per face vertex, normal, uv
+// and triangle counts, the ids of all face-vertices, and the face relative
+// vertex indices of all triangles.
+struct MeshTopology
+{
+    MIntArray   faceVertexCounts;
+    MIntArray   faceVertexIds;
+    MIntArray   faceNormalIds;
+    MIntArray   faceUvCounts;           // empty if the mesh has no uv's
+    MIntArray   faceUvIds;              // only faces with uv's have entries
+    MIntArray   triangleCounts;
+    MIntArray   triangleOffsets;
+    MIntArray   perFaceAssignments;     // material index of every face, or empty
+};
+
+// Read the topology of a mesh. Must be called from the main thread.
+void getMeshTopology(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    MeshTopology&           topology);
+
+// Triangulated topology of a mesh: three point, normal and uv indices per
+// triangle and one material index per triangle.
+struct MeshTriangles
+{
+    MIntArray   pointIndices;
+    MIntArray   normalIndices;
+    MIntArray   uvIndices;
+    MIntArray   materialIndices;
+
+    unsigned int size() const { return materialIndices.length(); }
+};
+
+// Triangulate a mesh in a single pass. Faces without uv's use uv index 0.
+// Doesn't access Maya, so it may be called from any thread.
+void triangulateMesh(
+    const MeshTopology&     topology,
+    MeshTriangles&          triangles);
+
+// Same as above, reading the topology from meshFn first.
+void triangulateMesh(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    MeshTriangles&          triangles);
+
+// Everything needed to build an appleseed mesh, copied out of Maya so that
+// the mesh can be built away from the main thread.
+struct MeshArrays
+{
+    std::vector<float>      points;     // xyz, object space
+    std::vector<float>      normals;    // xyz, object space
+    std::vector<float>      uvs;        // uv of the current uv set
+    MeshTopology            topology;
+    size_t                  materialSlotCount;
+
+    // Deformation motion poses after the first one, which is stored in
+    // points and normals. All poses share the topology.
+    std::vector<std::vector<float> >    pointPoses;
+    std::vector<std::vector<float> >    normalPoses;
+};
+
+// Copy the data of a mesh. Must be called from the main thread.
+void getMeshArrays(
+    MFnMesh&                meshFn,
+    const MIntArray&        perFaceAssignments,
+    const size_t            materialSlotCount,
+    MeshArrays&             arrays);
+
+// Return true if the construction history of a mesh contains animation
+// curves, expressions or time dependent nodes, i.e. if the mesh can deform
+// over time. Must be called from the main thread.
+bool hasAnimatedHistory(const MObject& meshObject);
+
+// Read the points and normals of a mesh at the given times, without changing
+// the current time, and store them as deformation poses: the first time
+// replaces the points and normals of arrays, the other ones become motion
+// poses. arrays must hold the mesh at the current time. If the mesh doesn't
+// move during these times, arrays is left untouched. Return false, leaving
+// arrays untouched, if the topology of the mesh differs at any of the times.
+// Must be called from the main thread.
+bool getMeshPoses(
+    const MObject&              meshObject,
+    const std::vector<MTime>&   times,
+    MeshArrays&                 arrays);
+
+// Read per vertex velocities, in units per second, from the first of the
+// given sources that exists on a mesh: a color set or a vector array
+// attribute with that name. Return false if there is none. Color sets are
+// read from the mesh to render, so they follow the smooth mesh preview;
+// vertices without a color get a zero velocity. Vector array attributes are
+// read from the shape and hold one velocity per cage vertex, so they don't
+// match a smoothed mesh. Must be called from the main thread.
+bool getMeshVelocities(
+    const MObject&              meshObject,
+    const MStringArray&         sources,
+    std::vector<float>&         velocities);
+
+// Move the points of mesh arrays along their velocities to get deformation
+// poses at the given offsets from the current time, in seconds. The first
+// offset replaces the points of arrays, the other ones become motion poses,
+// and all poses share the normals. Return false, leaving arrays untouched,
+// if there isn't one velocity per vertex. Doesn't access Maya.
+bool getVelocityPoses(
+    const std::vector<float>&   velocities,
+    const std::vector<double>&  offsets,
+    MeshArrays&                 arrays);
+
+// Build an appleseed mesh from mesh arrays. Normals are renormalized and
+// degenerate ones replaced by +Y; their number is returned in
+// degenerateNormalCount. Meshes without uv's get a single (0, 0) coordinate.
+// Deformation poses become motion segments of the mesh.
+// Doesn't access Maya, so it may be called from any thread.
+foundation::auto_release_ptr<renderer::MeshObject> buildMesh(
+    const char*             name,
+    const MeshArrays&       arrays,
+    size_t&                 degenerateNormalCount);
+
+// Hash of the geometry of an appleseed mesh: vertices, normals, uv's,
+// triangles, material slots and motion poses. The name is not included.
+foundation::uint64 hashMeshContent(const renderer::MeshObject& mesh);
+
+// Return true if two appleseed meshes have the same geometry.
+bool haveSameContent(const renderer::MeshObject& lhs, const renderer::MeshObject& rhs);
+
+// Approximate memory used by the geometry of an appleseed mesh, in bytes.
+size_t getMeshMemorySize(const renderer::MeshObject& mesh);
+
+// Part of the above used by the motion segments of the mesh, in bytes.
+size_t getMeshPosesMemorySize(const renderer::MeshObject& mesh);
+
 #endif  //! UTILITIES_MESHTOOLS_H
@@ -0,0 +1,401 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef UTILITIES_MPSCRINGBUFFER_H
+#define UTILITIES_MPSCRINGBUFFER_H
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/platform/types.h"
+
+// Boost headers.
+#include "boost/atomic/atomic.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <utility>
+
+//
+// Bounded, lock-free, multi-producer/single-consumer ring buffer.
+//
+// Each slot carries a sequence number telling producers and the consumer whether
+// the slot is free or holds a value (D. Vyukov's bounded queue). Producers only
+// contend on a single compare-and-swap of the tail index; the consumer never
+// blocks producers. Values are swapped in and out of the slots, never copied,
+// so T must be default constructible and provide a cheap swap().
+//
+// When the ring is full, droppable items are handled according to the current
+// backpressure policy; non-droppable items always wait for a free slot. With the
+// Coalesce policy a droppable item replaces the pending one with the same key,
+// e.g. the update of the same tile, and is handed out in the order it was pushed.
+//
+
+template <typename T>
+class MPSCRingBuffer
+  : public foundation::NonCopyable
+{
+  public:
+    enum BackpressurePolicy
+    {
+        Block = 0,          // wait for a free slot
+        Drop,               // discard droppable items
+        Coalesce            // keep only the most recent droppable item per key
+    };
+
+    struct Stats
+    {
+        size_t  pushed;     // items stored in the ring
+        size_t  popped;     // items taken from the ring by the consumer
+        size_t  contended;  // lost tail compare-and-swap races between producers
+        size_t  blocked;    // pushes that had to wait for a free slot
+        size_t  dropped;    // droppable items discarded by the Drop policy
+        size_t  coalesced;  // droppable items superseded by a newer one with the same key
+        size_t  highWater;  // maximum number of items seen in the ring
+        size_t  capacity;
+    };
+
+    // Capacity is rounded up to the next power of two.
+    explicit MPSCRingBuffer(const size_t capacity);
+    ~MPSCRingBuffer();
+
+    void setPolicy(const BackpressurePolicy policy);
+    BackpressurePolicy getPolicy() const;
+
+    // Thread-safe. On success the item is swapped into the ring and left
+    // default constructed. Returns false if the item was dropped.
+    bool push(T& item, const bool droppable = false, const foundation::uint64 key = 0);
+
+    // Consumer thread only.
+    bool tryPop(T& item);
+
+    // Consumer thread only. Discards all pending items.
+    void clear();
+
+    // Approximate when called while producers are active.
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+
+    Stats getStats() const;
+    void resetStats();
+
+  private:
+    struct Slot
+    {
+        boost::atomic<size_t>   sequence;
+        T                       value;
+    };
+
+    enum { CacheLineSize = 64 };
+
+    Slot*                               mSlots;
+    size_t                              mMask;
+    boost::atomic<int>                  mPolicy;
+
+    // Producer side.
+    char                                mPad0[CacheLineSize];
+    boost::atomic<size_t>               mTail;
+    char                                mPad1[CacheLineSize];
+
+    // Consumer side.
+    boost::atomic<size_t>               mHead;
+    size_t                              mHighWater;
+    char                                mPad2[CacheLineSize];
+
+    // Droppable item waiting outside of the ring with the Coalesce policy. It
+    // goes before the ring item at position, which was pushed after it.
+    struct OverflowItem
+    {
+        size_t  position;
+        size_t  order;
+        T       value;
+    };
+
+    typedef std::map<foundation::uint64, OverflowItem> OverflowMap;         // by key
+    typedef std::map<std::pair<size_t, size_t>, foundation::uint64> OverflowOrder;  // keys by position and order
+
+    // Rarely touched: overflow items of the Coalesce policy and counters of slow paths.
+    boost::mutex                        mOverflowMutex;
+    OverflowMap                         mOverflow;
+    OverflowOrder                       mOverflowOrder;
+    size_t                              mOverflowCount;
+    boost::atomic<size_t>               mOverflowFirst;     // position of the first overflow item, NoOverflow if none
+    boost::atomic<size_t>               mContended;
+    boost::atomic<size_t>               mBlocked;
+    boost::atomic<size_t>               mDropped;
+    boost::atomic<size_t>               mCoalesced;
+    size_t                              mPushedBase;
+    size_t                              mPoppedBase;
+
+    static const size_t NoOverflow = ~static_cast<size_t>(0);
+
+    bool tryPopOverflow(const size_t head, T& item);
+};
+
+
+//
+// MPSCRingBuffer class implementation.
+//
+
+template <typename T>
+const size_t MPSCRingBuffer<T>::NoOverflow;
+
+template <typename T>
+MPSCRingBuffer<T>::MPSCRingBuffer(const size_t capacity)
+  : mPolicy(Block)
+  , mTail(0)
+  , mHead(0)
+  , mHighWater(0)
+  , mOverflowCount(0)
+  , mOverflowFirst(NoOverflow)
+  , mContended(0)
+  , mBlocked(0)
+  , mDropped(0)
+  , mCoalesced(0)
+  , mPushedBase(0)
+  , mPoppedBase(0)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+
+    mSlots = new Slot[size];
+    mMask = size - 1;
+
+    for (size_t i = 0; i < size; ++i)
+        mSlots[i].sequence.store(i, boost::memory_order_relaxed);
+}
+
+template <typename T>
+MPSCRingBuffer<T>::~MPSCRingBuffer()
+{
+    delete [] mSlots;
+}
+
+template <typename T>
+void MPSCRingBuffer<T>::setPolicy(const BackpressurePolicy policy)
+{
+    mPolicy.store(policy, boost::memory_order_relaxed);
+}
+
+template <typename T>
+typename MPSCRingBuffer<T>::BackpressurePolicy MPSCRingBuffer<T>::getPolicy() const
+{
+    return static_cast<BackpressurePolicy>(mPolicy.load(boost::memory_order_relaxed));
+}
+
+template <typename T>
+bool MPSCRingBuffer<T>::push(T& item, const bool droppable, const foundation::uint64 key)
+{
+    bool waited = false;
+    size_t pos = mTail.load(boost::memory_order_relaxed);
+
+    while (true)
+    {
+        Slot& slot = mSlots[pos & mMask];
+        const size_t seq = slot.sequence.load(boost::memory_order_acquire);
+        const std::ptrdiff_t diff =
+            static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+        if (diff == 0)
+        {
+            // The slot is free: try to claim it.
+            if (mTail.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+            {
+                using std::swap;
+                swap(slot.value, item);
+                slot.sequence.store(pos + 1, boost::memory_order_release);
+                return true;
+            }
+
+            // Another producer claimed it first, pos has been reloaded.
+            mContended.fetch_add(1, boost::memory_order_relaxed);
+        }
+        else if (diff < 0)
+        {
+            // The ring is full.
+            const BackpressurePolicy policy = getPolicy();
+
+            if (droppable && policy == Drop)
+            {
+                mDropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+
+            if (droppable && policy == Coalesce)
+            {
+                boost::mutex::scoped_lock lock(mOverflowMutex);
+
+                typename OverflowMap::iterator i = mOverflow.find(key);
+                if (i != mOverflow.end())
+                {
+                    // The newer item takes the place of the pending one in the sequence.
+                    mCoalesced.fetch_add(1, boost::memory_order_relaxed);
+                    mOverflowOrder.erase(std::make_pair(i->second.position, i->second.order));
+                }
+                else i = mOverflow.insert(std::make_pair(key, OverflowItem())).first;
+
+                i->second.position = pos;
+                i->second.order = mOverflowCount++;
+                using std::swap;
+                swap(i->second.value, item);
+                item = T();
+
+                mOverflowOrder.insert(std::make_pair(std::make_pair(i->second.position, i->second.order), key));
+                mOverflowFirst.store(mOverflowOrder.begin()->first.first, boost::memory_order_release);
+                return true;
+            }
+
+            if (!waited)
+            {
+                mBlocked.fetch_add(1, boost::memory_order_relaxed);
+                waited = true;
+            }
+
+            boost::this_thread::yield();
+            pos = mTail.load(boost::memory_order_relaxed);
+        }
+        else
+        {
+            // Another producer moved the tail, catch up.
+            pos = mTail.load(boost::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool MPSCRingBuffer<T>::tryPop(T& item)
+{
+    const size_t head = mHead.load(boost::memory_order_relaxed);
+
+    // Overflow items are handed out before the ring items pushed after them.
+    if (mOverflowFirst.load(boost::memory_order_acquire) <= head && tryPopOverflow(head, item))
+        return true;
+
+    Slot& slot = mSlots[head & mMask];
+    const size_t seq = slot.sequence.load(boost::memory_order_acquire);
+
+    if (seq != head + 1)
+        return false;
+
+    const size_t pending = mTail.load(boost::memory_order_relaxed) - head;
+    mHighWater = std::max(mHighWater, pending);
+
+    using std::swap;
+    swap(item, slot.value);
+    slot.value = T();
+    slot.sequence.store(head + mMask + 1, boost::memory_order_release);
+    mHead.store(head + 1, boost::memory_order_relaxed);
+
+    return true;
+}
+
+template <typename T>
+bool MPSCRingBuffer<T>::tryPopOverflow(const size_t head, T& item)
+{
+    boost::mutex::scoped_lock lock(mOverflowMutex);
+
+    const typename OverflowOrder::iterator first = mOverflowOrder.begin();
+    if (first == mOverflowOrder.end() || first->first.first > head)
+        return false;
+
+    const typename OverflowMap::iterator i = mOverflow.find(first->second);
+    using std::swap;
+    swap(item, i->second.value);
+    mOverflow.erase(i);
+    mOverflowOrder.erase(first);
+
+    mOverflowFirst.store(
+        mOverflowOrder.empty() ? NoOverflow : mOverflowOrder.begin()->first.first,
+        boost::memory_order_release);
+
+    return true;
+}
+
+template <typename T>
+void MPSCRingBuffer<T>::clear()
+{
+    T item;
+    while (tryPop(item)) {}
+}
+
+template <typename T>
+size_t MPSCRingBuffer<T>::size() const
+{
+    const size_t tail = mTail.load(boost::memory_order_relaxed);
+    const size_t head = mHead.load(boost::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+template <typename T>
+bool MPSCRingBuffer<T>::empty() const
+{
+    return size() == 0 && mOverflowFirst.load(boost::memory_order_relaxed) == NoOverflow;
+}
+
+template <typename T>
+size_t MPSCRingBuffer<T>::capacity() const
+{
+    return mMask + 1;
+}
+
+template <typename T>
+typename MPSCRingBuffer<T>::Stats MPSCRingBuffer<T>::getStats() const
+{
+    // Pushes and pops are derived from the ring indices so that the fast path
+    // does not touch any shared counter.
+    Stats stats;
+    stats.pushed = mTail.load(boost::memory_order_relaxed) - mPushedBase;
+    stats.popped = mHead.load(boost::memory_order_relaxed) - mPoppedBase;
+    stats.contended = mContended.load(boost::memory_order_relaxed);
+    stats.blocked = mBlocked.load(boost::memory_order_relaxed);
+    stats.dropped = mDropped.load(boost::memory_order_relaxed);
+    stats.coalesced = mCoalesced.load(boost::memory_order_relaxed);
+    stats.highWater = mHighWater;
+    stats.capacity = capacity();
+    return stats;
+}
+
+template <typename T>
+void MPSCRingBuffer<T>::resetStats()
+{
+    mPushedBase = mTail.load(boost::memory_order_relaxed);
+    mPoppedBase = mHead.load(boost::memory_order_relaxed);
+    mHighWater = 0;
+    mContended.store(0, boost::memory_order_relaxed);
+    mBlocked.store(0, boost::memory_order_relaxed);
+    mDropped.store(0, boost::memory_order_relaxed);
+    mCoalesced.store(0, boost::memory_order_relaxed);
+}
+
+#endif  // !UTILITIES_MPSCRINGBUFFER_H
@@ -365,7 +365,7 @@ void OSLUtilClass::defineOSLParameter(ShaderAttribute& sa, MFnDependencyNode& de
         unsigned int index = getArrayIndex(sa.name);
         std::vector<std::string> pathElements;
         pystring::split(sa.compAttrArrayPath, pathElements, ".");
-        MPlug compoundPlug = depFn.findPlug(pathElements[0].c_str());
+        MPlug compoundPlug = findCachedPlug(depFn, pathElements[0].c_str());
         if (!compoundPlug.isNull())
         {
             if (compoundPlug.isArray())
@@ -401,7 +401,7 @@ void OSLUtilClass::defineOSLParameter(ShaderAttribute& sa, MFnDependencyNode& de
     {
         unsigned int index = getArrayIndex(sa.name);
         MString attrString = removeIndexFromName(MString(sa.name.c_str()), index);
-        MPlug arrayPlug = depFn.findPlug(attrString);
+        MPlug arrayPlug = findCachedPlug(depFn, attrString.asChar());
         if (arrayPlug.isArray())
         {
             unsigned int numElements = arrayPlug.numElements();
@@ -416,7 +416,7 @@ void OSLUtilClass::defineOSLParameter(ShaderAttribute& sa, MFnDependencyNode& de
 
     if (plug.isNull())
     {
-        plug = depFn.findPlug(sa.name.c_str());
+        plug = findCachedPlug(depFn, sa.name.c_str());
         if (plug.isNull())
             return;
     }
@@ -0,0 +1,138 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "phasetimer.h"
+
+// appleseed-maya headers.
+#include "utilities/logging.h"
+
+// Maya headers.
+#include <maya/MString.h>
+
+// Boost headers.
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    boost::mutex phasesMutex;
+    std::vector<PhaseTimings::Phase> phases;
+
+    // Incremented by clear() so that timers started before it don't report
+    // into the phases of the next frame.
+    size_t generation = 0;
+    const size_t GenerationShift = 24;
+}
+
+void PhaseTimings::clear()
+{
+    boost::mutex::scoped_lock lock(phasesMutex);
+    phases.clear();
+    ++generation;
+}
+
+size_t PhaseTimings::begin(const std::string& name)
+{
+    boost::mutex::scoped_lock lock(phasesMutex);
+
+    const size_t tag = (generation & 0xFF) << GenerationShift;
+
+    for (size_t i = 0; i < phases.size(); ++i)
+    {
+        if (phases[i].name == name)
+            return tag | i;
+    }
+
+    Phase phase;
+    phase.name = name;
+    phase.seconds = 0.0;
+    phase.count = 0;
+    phases.push_back(phase);
+
+    return tag | (phases.size() - 1);
+}
+
+void PhaseTimings::end(const size_t index, const double seconds)
+{
+    boost::mutex::scoped_lock lock(phasesMutex);
+
+    if ((index >> GenerationShift) != (generation & 0xFF))
+        return;
+
+    const size_t i = index & ((static_cast<size_t>(1) << GenerationShift) - 1);
+    if (i < phases.size())
+    {
+        phases[i].seconds += seconds;
+        ++phases[i].count;
+    }
+}
+
+std::vector<PhaseTimings::Phase> PhaseTimings::get()
+{
+    boost::mutex::scoped_lock lock(phasesMutex);
+    return phases;
+}
+
+void PhaseTimings::log(const float frameNumber)
+{
+    const std::vector<Phase> frameTimings = get();
+    if (frameTimings.empty())
+        return;
+
+    Logging::info(MString("Timings for frame ") + frameNumber + ":");
+
+    for (size_t i = 0; i < frameTimings.size(); ++i)
+    {
+        const Phase& phase = frameTimings[i];
+        const size_t depth = std::count(phase.name.begin(), phase.name.end(), '.');
+
+        char buffer[32];
+        sprintf(buffer, "%.3f s", phase.seconds);
+
+        MString line = MString(std::string(2 * (depth + 1), ' ').c_str()) + phase.name.c_str() + ": " + buffer;
+        if (phase.count > 1)
+            line += MString(" (") + static_cast<int>(phase.count) + " times)";
+        Logging::info(line);
+    }
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(const std::string& name)
+  : mIndex(PhaseTimings::begin(name))
+{
+    mStopwatch.start();
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+    PhaseTimings::end(mIndex, mStopwatch.measure().get_seconds());
+}
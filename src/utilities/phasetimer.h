@@ -0,0 +1,83 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef UTILITIES_PHASETIMER_H
+#define UTILITIES_PHASETIMER_H
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/platform/timers.h"
+#include "foundation/utility/stopwatch.h"
+
+// Standard headers.
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Wall clock durations of the phases of the current frame (scene parsing,
+// project definition, rendering...). Phases are kept in the order in which
+// they were started; nested phases are named "parent.child" and their time
+// is included in the parent's. A phase entered several times accumulates.
+// Phases may be timed from any thread.
+class PhaseTimings
+{
+  public:
+    struct Phase
+    {
+        std::string name;
+        double      seconds;
+        size_t      count;
+    };
+
+    // Forget all phases, called at the start of every frame.
+    static void clear();
+
+    // Register a phase and return its index, used to report its duration.
+    static size_t begin(const std::string& name);
+    static void end(const size_t index, const double seconds);
+
+    static std::vector<Phase> get();
+
+    // Log all phases of the frame at info level.
+    static void log(const float frameNumber);
+};
+
+// Times the enclosing scope as a phase of the current frame.
+class ScopedPhaseTimer
+  : public foundation::NonCopyable
+{
+  public:
+    explicit ScopedPhaseTimer(const std::string& name);
+    ~ScopedPhaseTimer();
+
+  private:
+    const size_t                                                mIndex;
+    foundation::Stopwatch<foundation::DefaultWallclockTimer>   mStopwatch;
+};
+
+#endif  // !UTILITIES_PHASETIMER_H
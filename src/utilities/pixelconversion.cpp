@@ -0,0 +1,273 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "pixelconversion.h"
+
+// appleseed.foundation headers.
+#include "foundation/image/pixel.h"
+#include "foundation/image/tile.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || _M_IX86_FP >= 2))
+#define PIXELCONVERSION_X86
+#endif
+
+// AVX2 intrinsics in functions with their own target attribute need Visual Studio 2012,
+// GCC 4.9 or clang 3.8. Older compilers, e.g. the GCC 4.8 used for Maya 2016 and 2017,
+// only get the SSE2 kernel.
+#ifdef PIXELCONVERSION_X86
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || \
+    (defined(__clang__) && (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+    (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define PIXELCONVERSION_AVX2
+#endif
+#endif
+
+#ifdef PIXELCONVERSION_X86
+#include <emmintrin.h>
+#ifdef PIXELCONVERSION_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXELCONVERSION_AVX2_TARGET
+#else
+#include <cpuid.h>
+#define PIXELCONVERSION_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    typedef void (*RowKernel)(const float* source, float* dest, const size_t floatCount);
+
+    void copyRow(const float* source, float* dest, const size_t floatCount)
+    {
+        memcpy(dest, source, floatCount * sizeof(float));
+    }
+
+    // NaN becomes 0, like with the max instructions of the SIMD kernels.
+    void saturateRowScalar(const float* source, float* dest, const size_t floatCount)
+    {
+        for (size_t i = 0; i < floatCount; ++i)
+            dest[i] = source[i] > 0.0f ? std::min(source[i], 1.0f) : 0.0f;
+    }
+
+#ifdef PIXELCONVERSION_X86
+
+    void saturateRowSSE2(const float* source, float* dest, const size_t floatCount)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        // One RGBA pixel per iteration, two at a time.
+        size_t i = 0;
+        for (; i + 8 <= floatCount; i += 8)
+        {
+            const __m128 a = _mm_loadu_ps(source + i);
+            const __m128 b = _mm_loadu_ps(source + i + 4);
+            _mm_storeu_ps(dest + i, _mm_min_ps(_mm_max_ps(a, zero), one));
+            _mm_storeu_ps(dest + i + 4, _mm_min_ps(_mm_max_ps(b, zero), one));
+        }
+
+        for (; i + 4 <= floatCount; i += 4)
+            _mm_storeu_ps(dest + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i), zero), one));
+
+        saturateRowScalar(source + i, dest + i, floatCount - i);
+    }
+
+#ifdef PIXELCONVERSION_AVX2
+
+    PIXELCONVERSION_AVX2_TARGET
+    void saturateRowAVX2(const float* source, float* dest, const size_t floatCount)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        // Two RGBA pixels per register, four at a time.
+        size_t i = 0;
+        for (; i + 16 <= floatCount; i += 16)
+        {
+            const __m256 a = _mm256_loadu_ps(source + i);
+            const __m256 b = _mm256_loadu_ps(source + i + 8);
+            _mm256_storeu_ps(dest + i, _mm256_min_ps(_mm256_max_ps(a, zero), one));
+            _mm256_storeu_ps(dest + i + 8, _mm256_min_ps(_mm256_max_ps(b, zero), one));
+        }
+
+        for (; i + 8 <= floatCount; i += 8)
+            _mm256_storeu_ps(dest + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i), zero), one));
+
+        saturateRowScalar(source + i, dest + i, floatCount - i);
+    }
+
+    void cpuid(int info[4], const int leaf)
+    {
+#ifdef _MSC_VER
+        __cpuidex(info, leaf, 0);
+#else
+        unsigned int a, b, c, d;
+        __cpuid_count(leaf, 0, a, b, c, d);
+        info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+    }
+
+    bool cpuHasAVX2()
+    {
+        int info[4];
+        cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX and OSXSAVE, then check that the OS saves the YMM registers.
+        cpuid(info, 1);
+        const int avxMask = (1 << 27) | (1 << 28);
+        if ((info[2] & avxMask) != avxMask)
+            return false;
+
+#ifdef _MSC_VER
+        const unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+        const unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        if ((xcr0 & 6) != 6)
+            return false;
+
+        cpuid(info, 7);
+        return (info[1] & (1 << 5)) != 0;
+    }
+
+#endif  // PIXELCONVERSION_AVX2
+
+#endif
+
+    struct Kernel
+    {
+        RowKernel   saturateRow;
+        const char* name;
+
+        Kernel()
+        {
+#if defined(PIXELCONVERSION_AVX2)
+            if (cpuHasAVX2())
+            {
+                saturateRow = saturateRowAVX2;
+                name = "avx2";
+            }
+            else
+            {
+                saturateRow = saturateRowSSE2;
+                name = "sse2";
+            }
+#elif defined(PIXELCONVERSION_X86)
+            saturateRow = saturateRowSSE2;
+            name = "sse2";
+#else
+            saturateRow = saturateRowScalar;
+            name = "scalar";
+#endif
+        }
+    };
+
+    const Kernel kernel;
+}
+
+void convertRGBAPixels(
+    const float*    source,
+    const size_t    sourceStride,
+    float*          dest,
+    const size_t    destStride,
+    const size_t    width,
+    const size_t    height,
+    const bool      saturate,
+    const bool      flipRows)
+{
+    const RowKernel rowKernel = saturate ? kernel.saturateRow : copyRow;
+    const size_t floatCount = width * 4;
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        const size_t destRow = flipRows ? height - 1 - y : y;
+        rowKernel(source + y * sourceStride, dest + destRow * destStride, floatCount);
+    }
+}
+
+void convertTileToDisplay(
+    const foundation::Tile& tile,
+    float*                  dest,
+    const size_t            destStride,
+    const bool              saturate)
+{
+    convertTileToDisplay(
+        tile,
+        0,
+        0,
+        tile.get_width(),
+        tile.get_height(),
+        dest,
+        destStride,
+        saturate);
+}
+
+void convertTileToDisplay(
+    const foundation::Tile& tile,
+    const size_t            x,
+    const size_t            y,
+    const size_t            width,
+    const size_t            height,
+    float*                  dest,
+    const size_t            destStride,
+    const bool              saturate)
+{
+    assert(tile.get_pixel_format() == foundation::PixelFormatFloat);
+    assert(tile.get_channel_count() == 4);
+    assert(x + width <= tile.get_width());
+    assert(y + height <= tile.get_height());
+
+    const size_t tileStride = tile.get_width() * 4;
+    convertRGBAPixels(
+        reinterpret_cast<const float*>(tile.get_storage()) + y * tileStride + x * 4,
+        tileStride,
+        dest,
+        destStride,
+        width,
+        height,
+        saturate,
+        true);
+}
+
+const char* getPixelConversionKernelName()
+{
+    return kernel.name;
+}
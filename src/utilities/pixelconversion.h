@@ -0,0 +1,81 @@
+
+//
+// This source file is part of appleseed.
+// Visit http://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2016 Haggi Krey, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef UTILITIES_PIXELCONVERSION_H
+#define UTILITIES_PIXELCONVERSION_H
+
+// Standard headers.
+#include <cstddef>
+
+// Forward declarations.
+namespace foundation { class Tile; }
+
+//
+// Conversion of rendered RGBA float pixels to the bottom-up layout used by
+// Maya's render view and Hypershade, optionally saturating to [0, 1].
+// The kernel (AVX2, SSE2 or scalar) is selected once at load time
+// according to the capabilities of the CPU.
+//
+
+// Copy a block of RGBA float pixels. Strides are expressed in floats and
+// the source and destination blocks must not overlap. If flipRows is true,
+// the first source row is written to the last destination row.
+void convertRGBAPixels(
+    const float*    source,
+    const size_t    sourceStride,
+    float*          dest,
+    const size_t    destStride,
+    const size_t    width,
+    const size_t    height,
+    const bool      saturate,
+    const bool      flipRows);
+
+// Copy a 4-channel float tile into a bottom-up RGBA float image.
+// dest points to the destination pixel receiving the bottom-left pixel of the tile.
+void convertTileToDisplay(
+    const foundation::Tile& tile,
+    float*                  dest,
+    const size_t            destStride,
+    const bool              saturate);
+
+// Same as above, restricted to the tile pixels [x, x + width) x [y, y + height)
+// in top-down tile coordinates.
+void convertTileToDisplay(
+    const foundation::Tile& tile,
+    const size_t            x,
+    const size_t            y,
+    const size_t            width,
+    const size_t            height,
+    float*                  dest,
+    const size_t            destStride,
+    const bool              saturate);
+
+// Name of the selected kernel: "avx2", "sse2" or "scalar".
+const char* getPixelConversionKernelName();
+
+#endif  // !UTILITIES_PIXELCONVERSION_H
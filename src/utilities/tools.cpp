@@ -36,6 +36,8 @@
 #include <maya/MSelectionList.h>
 #include <maya/MTransformationMatrix.h>
 #include <maya/MFnAttribute.h>
+#include <maya/MFnMatrixData.h>
+#include <maya/MDGContext.h>
 
 #include "utilities/tools.h"
 #include "utilities/attrtools.h"
@@ -163,28 +165,37 @@ bool IsPathTemplated(MDagPath& path)
     return false;
 }
 
+bool IsNodeLayerVisible(const MObject& node)
+{
+   MStatus stat;
+   MFnDependencyNode depFn(node);
+   MPlug doPlug = depFn.findPlug("drawOverride", &stat);
+   if (!stat)
+      return true;
+
+   MObject layer = getOtherSideNode(doPlug);
+   MFnDependencyNode layerNode(layer, &stat);
+   if (!stat)
+      return true;
+
+   bool visibility = true;
+   if (getBool("visibility", layerNode, visibility))
+      if (!visibility)
+         return false;
+   if (getEnumInt("displayType", layerNode) == 1) // template
+      return false;
+
+   return true;
+}
+
 bool IsLayerVisible(MDagPath& dp)
 {
    MStatus stat = MStatus::kSuccess;
    MDagPath dagPath = dp;
    while (stat == MStatus::kSuccess)
    {
-      MFnDependencyNode node(dagPath.node());
-      MPlug doPlug = node.findPlug("drawOverride", &stat);
-      if (stat)
-      {
-          MObject layer = getOtherSideNode(doPlug);
-          MFnDependencyNode layerNode(layer, &stat);
-          if (stat)
-          {
-              bool visibility = true;
-              if (getBool("visibility", layerNode, visibility))
-                  if (!visibility)
-                      return false;
-              if (getEnumInt("displayType", layerNode) == 1) // template
-                  return false;
-          }
-      }
+      if (!IsNodeLayerVisible(dagPath.node()))
+         return false;
       stat = dagPath.pop();
    }
    return true;
@@ -643,6 +654,30 @@ void posRotSclFromMatrix(MMatrix& matrix, MPoint& pos, MPoint& rot, MPoint& scl)
     scl.z = scaling[2];
 }
 
+MMatrix getWorldMatrixAtTime(const MDagPath& dagPath, const MTime& time)
+{
+    MStatus stat;
+    MFnDagNode dagFn(dagPath, &stat);
+    if (!stat)
+        return dagPath.inclusiveMatrix();
+
+    // worldMatrix is an array attribute with one element per instance of the node
+    MPlug worldMatrixPlug = dagFn.findPlug("worldMatrix", false, &stat);
+    if (!stat)
+        return dagPath.inclusiveMatrix();
+
+    MDGContext context(time);
+    MObject matrixObject = worldMatrixPlug.elementByLogicalIndex(dagPath.instanceNumber()).asMObject(context, &stat);
+    if (!stat || matrixObject.isNull())
+        return dagPath.inclusiveMatrix();
+
+    MFnMatrixData matrixData(matrixObject, &stat);
+    if (!stat)
+        return dagPath.inclusiveMatrix();
+
+    return matrixData.matrix();
+}
+
 MString getConnectedFileTexturePath(const MString& plugName, MFnDependencyNode& depFn)
 {
     MStatus stat;
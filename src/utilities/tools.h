@@ -37,6 +37,7 @@
 #include <maya/MMatrix.h>
 #include <maya/MPlug.h>
 #include <maya/MObjectArray.h>
+#include <maya/MTime.h>
 
 #include <cassert>
 #include <cmath>
@@ -66,6 +67,9 @@ bool IsInRenderLayer(MDagPath& dagPath);
 
 bool IsLayerVisible(MDagPath& dagPath);
 
+// check only the display layer the node itself is connected to, not the layers of its parents
+bool IsNodeLayerVisible(const MObject& node);
+
 bool IsPathVisible(MDagPath& dagPath);
 
 MObject getOtherSideNode(const MString& plugName, MObject& thisObject);
@@ -112,6 +116,9 @@ MObject objectFromName(MString name);
 
 void posRotSclFromMatrix(MMatrix& matrix, MPoint& pos, MVector& rot, MVector& scl);
 
+// Evaluate the world matrix of a dag path at the given time without changing the current time.
+MMatrix getWorldMatrixAtTime(const MDagPath& dagPath, const MTime& time);
+
 void posRotSclFromMatrix(MMatrix& matrix, MPoint& pos, MPoint& rot, MPoint& scl);
 
 bool getConnectedFileTexturePath(const MString& plugName, MString& nodeName, MString& value, MObject& outFileNode);